@@ -0,0 +1,166 @@
+/*
+ * Times the batched transform kernels against the glm path they replaced:
+ * glm::mat4_cast() + translation + glm::scale() for local matrices, and a full mat4 multiply for world matrices.
+ * Each kernel's output is checked against glm before it is timed.
+ *
+ * usage: enginebench [transform count] [repetitions]
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/mat4x3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "transform_kernels.h"
+
+using namespace engine;
+
+static constexpr uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+static constexpr float TOLERANCE = 1e-4f; // relative to the largest element compared
+
+struct Transform {
+    glm::vec3 position;
+    glm::quat rotation;
+    glm::vec3 scale;
+};
+
+// the same as TransformSystem's LocalMatrix()
+static glm::mat4 GlmLocalMatrix(const Transform& t)
+{
+    glm::mat4 transform = glm::mat4_cast(t.rotation);
+    reinterpret_cast<glm::vec3&>(transform[3]) = t.position;
+    return glm::scale(transform, t.scale);
+}
+
+// best time of 'repetitions' runs of func(), in milliseconds
+template <typename Func>
+static double TimeBest(int repetitions, Func&& func)
+{
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < repetitions; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        const auto finish = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(finish - start).count());
+    }
+    return best;
+}
+
+// largest difference between 'actual' and 'expected', relative to the largest element of 'expected'
+static float MaxRelativeError(const std::vector<glm::mat4x3>& actual, const std::vector<glm::mat4>& expected)
+{
+    float max_error = 0.0f;
+    for (size_t i = 0; i < actual.size(); ++i) {
+        float magnitude = 1.0f;
+        float error = 0.0f;
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 3; ++row) {
+                magnitude = std::max(magnitude, std::abs(expected[i][column][row]));
+                error = std::max(error, std::abs(actual[i][column][row] - expected[i][column][row]));
+            }
+        }
+        max_error = std::max(max_error, error / magnitude);
+    }
+    return max_error;
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t count = (argc >= 2) ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    const int repetitions = (argc >= 3) ? std::atoi(argv[2]) : 20;
+    if (count == 0 || repetitions <= 0) {
+        std::fprintf(stderr, "usage: %s [transform count] [repetitions]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const TransformKernelLevel picked_level = GetTransformKernelLevel();
+    std::printf("kernel picked for this CPU: %s\n", GetTransformKernelName(picked_level));
+    std::printf("%zu transforms, best of %d runs\n\n", count, repetitions);
+
+    // random transforms in a hierarchy where every parent comes before its children, like TransformSystem's slots
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position_dist(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> unit_dist(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> scale_dist(0.25f, 4.0f);
+    std::vector<Transform> transforms(count);
+    std::vector<uint32_t> parents(count);
+    std::vector<uint32_t> child_slots{};
+    TransformArrays trs{};
+    for (size_t i = 0; i < count; ++i) {
+        Transform& t = transforms[i];
+        t.position = glm::vec3{position_dist(rng), position_dist(rng), position_dist(rng)};
+        t.rotation = glm::normalize(glm::quat{unit_dist(rng), unit_dist(rng), unit_dist(rng), unit_dist(rng)});
+        t.scale = glm::vec3{scale_dist(rng), scale_dist(rng), scale_dist(rng)};
+        trs.push(t.position, t.rotation, t.scale);
+
+        // roughly one root in sixteen, and children close to their parents
+        if (i == 0 || rng() % 16 == 0) {
+            parents[i] = NO_PARENT;
+        }
+        else {
+            const uint32_t max_distance = static_cast<uint32_t>(std::min<size_t>(i, 64));
+            parents[i] = static_cast<uint32_t>(i) - 1 - static_cast<uint32_t>(rng() % max_distance);
+            child_slots.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    /* glm reference */
+
+    std::vector<glm::mat4> glm_local(count);
+    std::vector<glm::mat4> glm_world(count);
+    const double glm_compose_ms = TimeBest(repetitions, [&]() {
+        for (size_t i = 0; i < count; ++i) {
+            glm_local[i] = GlmLocalMatrix(transforms[i]);
+        }
+    });
+    const double glm_multiply_ms = TimeBest(repetitions, [&]() {
+        for (size_t i = 0; i < count; ++i) {
+            glm_world[i] = (parents[i] == NO_PARENT) ? glm_local[i] : glm_world[parents[i]] * glm_local[i];
+        }
+    });
+
+    std::printf("%-8s  compose %8.3f ms  multiply %8.3f ms\n", "glm", glm_compose_ms, glm_multiply_ms);
+
+    /* kernels */
+
+    bool all_match = true;
+    std::vector<glm::mat4x3> local(count);
+    std::vector<glm::mat4x3> world(count);
+    for (TransformKernelLevel level : {TransformKernelLevel::SCALAR, TransformKernelLevel::SSE2, TransformKernelLevel::AVX2}) {
+        if (level > picked_level) break; // not supported by this CPU
+
+        // checked against glm first, each kernel starting from glm's local matrices so errors don't carry over
+        ComposeTransforms(trs, 0, count, local.data(), level);
+        const float compose_error = MaxRelativeError(local, glm_local);
+        for (size_t i = 0; i < count; ++i) {
+            local[i] = glm::mat4x3(glm_local[i]);
+            if (parents[i] == NO_PARENT) world[i] = local[i];
+        }
+        MultiplyAffineTransforms(world.data(), local.data(), parents.data(), child_slots.data(), child_slots.size(), level);
+        const float multiply_error = MaxRelativeError(world, glm_world);
+
+        const double compose_ms = TimeBest(repetitions, [&]() { ComposeTransforms(trs, 0, count, local.data(), level); });
+        const double multiply_ms = TimeBest(repetitions, [&]() {
+            MultiplyAffineTransforms(world.data(), local.data(), parents.data(), child_slots.data(), child_slots.size(), level);
+        });
+
+        const bool match = compose_error <= TOLERANCE && multiply_error <= TOLERANCE;
+        all_match &= match;
+        std::printf("%-8s  compose %8.3f ms  multiply %8.3f ms  (%.2fx, %.2fx vs glm)  max error %.2g, %.2g%s\n", GetTransformKernelName(level),
+                    compose_ms, multiply_ms, glm_compose_ms / compose_ms, glm_multiply_ms / multiply_ms, compose_error, multiply_error,
+                    match ? "" : "  MISMATCH");
+    }
+
+    return all_match ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -7,6 +7,7 @@
 
 #include "debug_line.h"
 #include "gfx.h"
+#include "job_system.h"
 #include "resource_manager.h"
 
 namespace engine {
@@ -19,10 +20,12 @@ class SceneManager; // forward-dec
 
 struct AppConfiguration {
     bool enable_frame_limiter;
+    JobSystemInfo job_system_info{};
 };
 
 class Application {
 private:
+    std::unique_ptr<JobSystem> m_job_system; // first so that it outlives everything that queues jobs
     std::unique_ptr<Window> m_window;
     std::unique_ptr<InputManager> m_input_manager;
     std::unique_ptr<Renderer> m_renderer;
@@ -60,6 +63,7 @@ public:
     InputManager* getInputManager() { return m_input_manager.get(); }
     SceneManager* getSceneManager() { return m_scene_manager.get(); }
     Renderer* getRenderer() { return m_renderer.get(); }
+    JobSystem* getJobSystem() { return m_job_system.get(); }
     std::string getResourcePath(const std::string relative_path) const { return (m_resources_path / relative_path).string(); }
 
 private:
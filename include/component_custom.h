@@ -14,6 +14,7 @@ class ComponentCustomImpl {
     friend CustomBehaviourSystem; // to set scene and entity on init
 
 protected:
+    // Structural changes made in init() or update() must go through m_scene->GetCommandBuffer(), which is played back after the update
     Scene* m_scene = nullptr;
     Entity m_entity = 0u;
 
@@ -1,25 +1,23 @@
 #pragma once
 
-#include <string>
-
 #include <glm/gtc/quaternion.hpp>
-#include <glm/mat4x4.hpp>
+#include <glm/mat4x3.hpp>
 #include <glm/vec3.hpp>
 
 #include "ecs.h"
 
 namespace engine {
 
+// Kept small, as every transform is visited each update. Names live in the scene's tag table.
 struct TransformComponent {
-    std::string tag;
-
-    glm::mat4 world_matrix;
+    glm::mat4x3 world_matrix; // affine, the bottom row is always 0, 0, 0, 1. Use glm::mat4(world_matrix) for the full matrix.
 
     glm::quat rotation;
     glm::vec3 position;
     glm::vec3 scale;
 
-    Entity parent;
+    Entity parent;   // change with Scene::SetEntityParent()
+    uint32_t tag_id; // read with Scene::GetEntityTag(), change with Scene::SetEntityTag()
 
     bool is_static;
 };
@@ -4,59 +4,65 @@
 #include <cstddef>
 #include <cstdint>
 
-#include <bitset>
 #include <map>
 #include <set>
 #include <vector>
 
+#include "ecs_signature.h"
+#include "ecs_sparse_set.h"
 #include "entity.h"
 
 namespace engine {
 
 class Scene; // forward-dec
 
-constexpr size_t MAX_COMPONENTS = 10;
-
-class IComponentArray {
-public:
-    virtual ~IComponentArray() = default;
+// How a component type's data is stored by the scene
+enum class ComponentStorage {
+    ARCHETYPE,  // packed with the entity's other components in archetype chunks. Fastest iteration.
+    SPARSE_SET, // kept in its own pool. Adding and removing doesn't move the entity's other components. Best for rare or frequently toggled components.
 };
 
+// Return a new process-wide id on each call. Used by getComponentTypeId<T>() and getSystemTypeId<T>().
+size_t nextComponentTypeId();
+size_t nextSystemTypeId();
+
+/*
+ * Every component type is given a small integer id the first time it is used.
+ * The id is the component's signature position in every scene, so finding a component pool is a single array index.
+ */
 template <typename T>
-class ComponentArray : public IComponentArray {
-private:
-    std::vector<T> m_component_array{};
+size_t getComponentTypeId()
+{
+    static const size_t s_id = nextComponentTypeId();
+    return s_id;
+}
 
-public:
-    void insertData(Entity entity, T&& component)
-    {
-        if (m_component_array.size() < entity + 1) {
-            m_component_array.resize(entity + 1);
-        }
-        // bounds checking here as not performance critical
-        m_component_array.at(entity) = std::move(component);
-    }
-
-    void removeData(Entity entity)
-    {
-        (void)entity; // TODO
-    }
-
-    T* getData(Entity entity)
-    {
-        assert(entity < m_component_array.size());
-        return &m_component_array[entity];
-    }
-};
+// Same as getComponentTypeId() but for systems, which are counted separately
+template <typename T>
+size_t getSystemTypeId()
+{
+    static const size_t s_id = nextSystemTypeId();
+    return s_id;
+}
 
 class System {
 public:
     Scene* const m_scene;
-    std::bitset<MAX_COMPONENTS> m_signature;
-    std::set<Entity> m_entities{}; // entities that contain the needed components
+    Signature m_signature;
+    EntitySet m_entities{}; // entities that contain the needed components
+
+    // Components accessed by onUpdate(). The scene updates systems concurrently when their accesses don't conflict.
+    // Until declareAccess() is called, a system is exclusive: it updates alone, in registration order relative to every other system.
+    Signature m_reads{};
+    Signature m_writes{};
+    bool m_exclusive = true;
+
+    // The scene's change tick when onUpdate() last ran, 0 before the first update.
+    // Pass it to SceneView::where() to visit only entities changed since then, not counting this system's own writes.
+    uint32_t m_last_run_tick = 0;
 
 public:
-    System(Scene* scene, std::set<size_t> required_component_hashes);
+    System(Scene* scene, std::set<size_t> required_component_ids); // ids from getComponentTypeId()
     System(const System&) = delete;
 
     virtual ~System() {}
@@ -66,6 +72,14 @@ public:
     virtual void onUpdate(float ts) = 0;
     virtual void onComponentInsert(Entity) {}
     virtual void onComponentRemove(Entity) {}
+
+    // true if the two systems must not update at the same time
+    static bool conflicts(const System& a, const System& b);
+
+protected:
+    // Declares every component read or written by onUpdate(). This is also a promise that onUpdate() doesn't touch state belonging to
+    // other systems, and only adds or removes components or creates or destroys entities through Scene::GetCommandBuffer().
+    void declareAccess(std::set<size_t> read_component_ids, std::set<size_t> write_component_ids);
 };
 
 } // namespace engine
\ No newline at end of file
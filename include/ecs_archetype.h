@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "ecs_change_tick.h"
+#include "ecs_signature.h"
+#include "entity.h"
+#include "util.h"
+
+namespace engine {
+
+// Size of each block of component memory. Every chunk holds as many entities as will fit.
+constexpr size_t ARCHETYPE_CHUNK_SIZE = 16 * 1024;
+
+// Type-erased operations needed to move components between archetypes
+struct ComponentTypeInfo {
+    size_t size;
+    size_t alignment;
+    uint64_t name_hash;       // hash of the type's name, which identifies the type in scene snapshots
+    bool trivially_copyable;  // can be saved to and loaded from scene snapshots as raw bytes
+    void (*relocate)(void* dst, void* src); // move-constructs dst from src then destroys src
+    void (*copy)(void* dst, const void* src); // copy-constructs dst from src, nullptr if the type isn't copy constructible
+    void (*destroy)(void* ptr);
+};
+
+template <typename T>
+ComponentTypeInfo makeComponentTypeInfo()
+{
+    ComponentTypeInfo info{};
+    info.size = sizeof(T);
+    info.alignment = alignof(T);
+    info.name_hash = HashBytes(typeid(T).name(), strlen(typeid(T).name()));
+    info.trivially_copyable = std::is_trivially_copyable_v<T>;
+    info.relocate = [](void* dst, void* src) {
+        new (dst) T(std::move(*static_cast<T*>(src)));
+        static_cast<T*>(src)->~T();
+    };
+    if constexpr (std::is_copy_constructible_v<T>) {
+        info.copy = [](void* dst, const void* src) { new (dst) T(*static_cast<const T*>(src)); };
+    }
+    info.destroy = [](void* ptr) { static_cast<T*>(ptr)->~T(); };
+    return info;
+}
+
+/*
+ * An archetype stores every entity that has exactly the same set of components.
+ * Component data is kept in fixed-size chunks as structure-of-arrays,
+ * so each component type is a contiguous column within a chunk. Each column has a matching column of ComponentTicks.
+ * Rows are kept tightly packed; removing an entity moves the last row into the gap.
+ */
+class Archetype {
+    Signature m_signature;
+    std::array<int, MAX_COMPONENTS> m_columns{}; // signature position -> column index, -1 if not in this archetype
+    std::vector<size_t> m_column_positions{};    // column index -> signature position
+    std::vector<ComponentTypeInfo> m_column_infos{};
+    std::vector<size_t> m_column_offsets{}; // byte offset of each column from the start of a chunk
+    std::vector<size_t> m_tick_offsets{};   // byte offset of each column's ticks from the start of a chunk
+    size_t m_chunk_capacity = 0;            // entities per chunk
+    size_t m_chunk_bytes = 0;
+    std::vector<std::byte*> m_chunks{};
+    size_t m_size = 0;
+
+public:
+    // 'component_infos' is indexed by signature position and must cover every bit set in 'signature'
+    Archetype(const Signature& signature, const std::vector<ComponentTypeInfo>& component_infos);
+    Archetype(const Archetype&) = delete;
+
+    ~Archetype();
+
+    Archetype& operator=(const Archetype&) = delete;
+
+    const Signature& getSignature() const { return m_signature; }
+    size_t size() const { return m_size; }
+    size_t getChunkCount() const { return m_chunks.size(); }
+    size_t getChunkCapacity() const { return m_chunk_capacity; }
+    size_t getChunkSize(size_t chunk) const { return (chunk + 1 < m_chunks.size()) ? m_chunk_capacity : m_size - chunk * m_chunk_capacity; }
+    Entity* getChunkEntities(size_t chunk) { return reinterpret_cast<Entity*>(m_chunks[chunk]); }
+
+    // returns nullptr if this archetype doesn't contain the component
+    void* getChunkColumn(size_t chunk, size_t signature_position)
+    {
+        const int column = m_columns[signature_position];
+        if (column < 0) return nullptr;
+        return m_chunks[chunk] + m_column_offsets[column];
+    }
+
+    // returns nullptr if this archetype doesn't contain the component
+    void* getComponent(size_t row, size_t signature_position)
+    {
+        const int column = m_columns[signature_position];
+        if (column < 0) return nullptr;
+        return m_chunks[row / m_chunk_capacity] + m_column_offsets[column] + (row % m_chunk_capacity) * m_column_infos[column].size;
+    }
+
+    // returns nullptr if this archetype doesn't contain the component
+    ComponentTicks* getChunkTicks(size_t chunk, size_t signature_position)
+    {
+        const int column = m_columns[signature_position];
+        if (column < 0) return nullptr;
+        return reinterpret_cast<ComponentTicks*>(m_chunks[chunk] + m_tick_offsets[column]);
+    }
+
+    // returns nullptr if this archetype doesn't contain the component
+    ComponentTicks* getTicks(size_t row, size_t signature_position)
+    {
+        const int column = m_columns[signature_position];
+        if (column < 0) return nullptr;
+        return reinterpret_cast<ComponentTicks*>(m_chunks[row / m_chunk_capacity] + m_tick_offsets[column]) + (row % m_chunk_capacity);
+    }
+
+    Entity getEntity(size_t row) { return getChunkEntities(row / m_chunk_capacity)[row % m_chunk_capacity]; }
+
+    // Adds a row for 'entity' and returns its index. Component memory and ticks in the new row are left uninitialised.
+    size_t allocateRow(Entity entity);
+
+    // Adds consecutive rows for 'count' entities, allocating every chunk needed up front, and returns the index of the first.
+    // Component memory and ticks in the new rows are left uninitialised.
+    size_t allocateRows(const Entity* entities, size_t count);
+
+    // Destroys the components in 'row' and fills the gap with the last row.
+    // Returns the entity that was moved into 'row', or 0 if no entity was moved.
+    Entity removeRow(size_t row);
+
+    // Relocates the components and ticks of 'row' that also exist in 'dst' and destroys the rest.
+    // Components in 'dst' that don't exist here are left uninitialised.
+    // Returns the new row in 'dst', and the entity that was moved into 'row' (0 if none).
+    std::pair<size_t, Entity> moveRow(size_t row, Archetype& dst);
+
+private:
+    Entity fillGap(size_t row);
+};
+
+} // namespace engine
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+namespace engine {
+
+/*
+ * The scene's change tick advances after every stage of systems.
+ * Each component remembers the tick it was added at, and the tick it was last written at through a mutable accessor,
+ * so systems can skip entities that haven't changed since they last ran.
+ */
+struct ComponentTicks {
+    uint32_t added;
+    uint32_t changed;
+};
+
+// Filters for SceneView::where()
+template <typename T>
+struct Changed {};
+template <typename T>
+struct Added {};
+
+template <typename Filter>
+struct TickFilterTraits;
+
+template <typename T>
+struct TickFilterTraits<Changed<T>> {
+    using Component = T;
+    static constexpr bool ADDED = false;
+};
+
+template <typename T>
+struct TickFilterTraits<Added<T>> {
+    using Component = T;
+    static constexpr bool ADDED = true;
+};
+
+} // namespace engine
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/ext/quaternion_float.hpp>
+
+#include "ecs.h"
+#include "ecs_archetype.h"
+#include "entity.h"
+
+namespace engine {
+
+/*
+ * Records entity creation and destruction and component addition and removal, to be played back by the scene later.
+ * Recording doesn't touch the scene, so it is safe while the scene is being iterated and from jobs, as long as
+ * each thread records into its own buffer (see Scene::GetCommandBuffer()).
+ * Playback sorts the commands by entity and moves each entity to its final archetype once, however many components were added or removed.
+ */
+class EntityCommandBuffer {
+    friend class Scene; // plays the commands back
+
+public:
+    // An entity created by createEntity() that doesn't exist yet. Only valid for commands in the same buffer.
+    struct PendingEntity {
+        uint32_t index; // into m_creates
+    };
+
+    // Either an existing entity or a PendingEntity
+    struct EntityRef {
+        static constexpr uint32_t NOT_PENDING = UINT32_MAX;
+
+        Entity entity = 0;
+        uint32_t pending = NOT_PENDING;
+
+        EntityRef(Entity existing) : entity(existing) {}
+        EntityRef(PendingEntity created) : pending(created.index) {}
+    };
+
+public:
+    EntityCommandBuffer() = default;
+    EntityCommandBuffer(const EntityCommandBuffer&) = delete;
+
+    ~EntityCommandBuffer();
+
+    EntityCommandBuffer& operator=(const EntityCommandBuffer&) = delete;
+
+    // Same arguments as Scene::CreateEntity(). Entities are created in the order they are recorded, before any other commands in the buffer.
+    PendingEntity createEntity(const std::string& tag, EntityRef parent = Entity{0}, const glm::vec3& pos = glm::vec3{0.0f, 0.0f, 0.0f},
+                               const glm::quat& rot = glm::quat{1.0f, 0.0f, 0.0f, 0.0f}, const glm::vec3& scl = glm::vec3{1.0f, 1.0f, 1.0f});
+
+    // Destroys the entity and its children. Other commands on the entity are dropped.
+    void destroyEntity(EntityRef entity) { m_commands.push_back(Command{CommandType::DESTROY_ENTITY, entity, 0, nullptr, nullptr}); }
+
+    // The component is moved into the buffer now and into the scene on playback
+    template <typename T>
+    void addComponent(EntityRef entity, T&& comp = T{})
+    {
+        static const ComponentTypeInfo s_info = makeComponentTypeInfo<T>();
+        void* data = allocate(sizeof(T), alignof(T));
+        new (data) T(std::move(comp));
+        m_commands.push_back(Command{CommandType::ADD_COMPONENT, entity, getComponentTypeId<T>(), data, &s_info});
+    }
+
+    template <typename T>
+    void removeComponent(EntityRef entity)
+    {
+        m_commands.push_back(Command{CommandType::REMOVE_COMPONENT, entity, getComponentTypeId<T>(), nullptr, nullptr});
+    }
+
+    bool empty() const { return m_creates.empty() && m_commands.empty(); }
+
+    // Drops every recorded command. Memory is kept for reuse.
+    void clear();
+
+private:
+    enum class CommandType : uint8_t { DESTROY_ENTITY, ADD_COMPONENT, REMOVE_COMPONENT };
+
+    struct Command {
+        CommandType type;
+        EntityRef entity;
+        size_t component_id;            // ADD_COMPONENT and REMOVE_COMPONENT
+        void* data;                     // ADD_COMPONENT, component waiting to be moved into the scene. nullptr once moved.
+        const ComponentTypeInfo* info;  // ADD_COMPONENT
+    };
+
+    struct CreateCommand {
+        std::string tag;
+        EntityRef parent;
+        glm::vec3 pos;
+        glm::quat rot;
+        glm::vec3 scl;
+    };
+
+    static constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+    std::vector<CreateCommand> m_creates{};
+    std::vector<Command> m_commands{};
+
+    // component data is bump allocated from blocks that are kept between clears
+    std::vector<std::unique_ptr<std::byte[]>> m_blocks{};
+    size_t m_current_block = 0;
+    size_t m_block_offset = 0;
+    std::vector<std::unique_ptr<std::byte[]>> m_large_allocations{}; // components too big for a block
+
+    void* allocate(size_t size, size_t alignment);
+    // destroys the components of ADD_COMPONENT commands that weren't played back
+    static void destroyComponents(std::vector<Command>& commands);
+};
+
+} // namespace engine
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <bit>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ENGINE_SIGNATURE_SSE2
+#endif
+
+// Can be set from CMake with ENGINE_MAX_COMPONENTS
+#ifndef ENGINE_MAX_COMPONENTS
+#define ENGINE_MAX_COMPONENTS 256
+#endif
+
+namespace engine {
+
+constexpr size_t MAX_COMPONENTS = ENGINE_MAX_COMPONENTS;
+
+/*
+ * A fixed-size bit set with one bit per component type.
+ * Words are 16-byte aligned so that subset and equality tests can compare 128 bits at a time.
+ */
+class Signature {
+public:
+    static constexpr size_t WORD_COUNT = (MAX_COMPONENTS + 63) / 64;
+
+private:
+    alignas(16) std::array<uint64_t, WORD_COUNT> m_words{};
+
+public:
+    bool test(size_t position) const { return (m_words[position / 64] >> (position % 64)) & 1; }
+    void set(size_t position) { m_words[position / 64] |= uint64_t{1} << (position % 64); }
+    void reset(size_t position) { m_words[position / 64] &= ~(uint64_t{1} << (position % 64)); }
+
+    bool none() const
+    {
+        uint64_t bits = 0;
+        for (uint64_t word : m_words) {
+            bits |= word;
+        }
+        return bits == 0;
+    }
+
+    size_t count() const
+    {
+        size_t total = 0;
+        for (uint64_t word : m_words) {
+            total += std::popcount(word);
+        }
+        return total;
+    }
+
+    // true if every bit set in this signature is also set in 'other'
+    bool isSubsetOf(const Signature& other) const
+    {
+#ifdef ENGINE_SIGNATURE_SSE2
+        if constexpr (WORD_COUNT % 2 == 0) {
+            __m128i missing = _mm_setzero_si128();
+            for (size_t i = 0; i < WORD_COUNT; i += 2) {
+                const __m128i mine = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_words[i]));
+                const __m128i theirs = _mm_load_si128(reinterpret_cast<const __m128i*>(&other.m_words[i]));
+                missing = _mm_or_si128(missing, _mm_andnot_si128(theirs, mine));
+            }
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xFFFF;
+        }
+#endif
+        // no early out, so this loop can be vectorised
+        uint64_t missing = 0;
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            missing |= m_words[i] & ~other.m_words[i];
+        }
+        return missing == 0;
+    }
+
+    // calls func(size_t position) for every set bit, in increasing order
+    template <typename Func>
+    void forEachSetBit(Func&& func) const
+    {
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            uint64_t word = m_words[i];
+            while (word != 0) {
+                func(i * 64 + std::countr_zero(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+    size_t hash() const
+    {
+        size_t h = 0;
+        for (uint64_t word : m_words) {
+            h ^= std::hash<uint64_t>{}(word) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        }
+        return h;
+    }
+
+    Signature operator&(const Signature& other) const
+    {
+        Signature result{};
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            result.m_words[i] = m_words[i] & other.m_words[i];
+        }
+        return result;
+    }
+
+    Signature operator|(const Signature& other) const
+    {
+        Signature result{};
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            result.m_words[i] = m_words[i] | other.m_words[i];
+        }
+        return result;
+    }
+
+    bool operator==(const Signature& other) const { return m_words == other.m_words; }
+};
+
+} // namespace engine
+
+template <>
+struct std::hash<engine::Signature> {
+    size_t operator()(const engine::Signature& signature) const { return signature.hash(); }
+};
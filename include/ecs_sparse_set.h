@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ecs_change_tick.h"
+#include "entity.h"
+
+namespace engine {
+
+/*
+ * A set of entities stored as a packed dense array, with a paged sparse index from entity index to dense index.
+ * Insertion, removal, and lookup are O(1), and iteration is a linear walk over the dense array.
+ * Removal swaps the last entity into the gap, so iteration order is not stable across removals.
+ */
+class EntitySet {
+    static constexpr size_t PAGE_SIZE = 4096; // entities per sparse page
+
+    std::vector<std::unique_ptr<uint32_t[]>> m_sparse_pages{}; // pages are only allocated once an entity in their range is inserted
+    std::vector<Entity> m_dense{};
+
+public:
+    static constexpr uint32_t NULL_INDEX = std::numeric_limits<uint32_t>::max();
+
+    bool contains(Entity entity) const { return indexOf(entity) != NULL_INDEX; }
+
+    // returns the dense index of the entity, or NULL_INDEX if not in the set
+    // also returns NULL_INDEX for stale handles whose index has been reused
+    uint32_t indexOf(Entity entity) const
+    {
+        const size_t page = entityIndex(entity) / PAGE_SIZE;
+        if (page >= m_sparse_pages.size() || m_sparse_pages[page] == nullptr) return NULL_INDEX;
+        const uint32_t index = m_sparse_pages[page][entityIndex(entity) % PAGE_SIZE];
+        if (index == NULL_INDEX || m_dense[index] != entity) return NULL_INDEX;
+        return index;
+    }
+
+    // returns the dense index of the new entity, which is always at the end
+    uint32_t insert(Entity entity)
+    {
+        assert(contains(entity) == false && "Inserting entity into set more than once.");
+        const uint32_t index = static_cast<uint32_t>(m_dense.size());
+        sparseSlot(entity) = index;
+        m_dense.push_back(entity);
+        return index;
+    }
+
+    // Inserts every entity not already in the set. Storage is reserved once for the whole batch.
+    void insert(const Entity* entities, size_t count)
+    {
+        m_dense.reserve(m_dense.size() + count);
+        for (size_t i = 0; i < count; ++i) {
+            if (contains(entities[i]) == false) {
+                insert(entities[i]);
+            }
+        }
+    }
+
+    // Returns the dense index the entity was removed from. The last entity has been moved into that index.
+    uint32_t erase(Entity entity)
+    {
+        const uint32_t index = indexOf(entity);
+        assert(index != NULL_INDEX && "Removing entity that isn't in the set.");
+        const Entity last_entity = m_dense.back();
+        if (last_entity != entity) {
+            m_dense[index] = last_entity;
+            sparseSlot(last_entity) = index;
+        }
+        m_dense.pop_back();
+        m_sparse_pages[entityIndex(entity) / PAGE_SIZE][entityIndex(entity) % PAGE_SIZE] = NULL_INDEX;
+        return index;
+    }
+
+    void reserve(size_t capacity) { m_dense.reserve(capacity); }
+    size_t size() const { return m_dense.size(); }
+    bool empty() const { return m_dense.empty(); }
+    const Entity* data() const { return m_dense.data(); }
+    Entity operator[](size_t index) const { return m_dense[index]; }
+
+    std::vector<Entity>::const_iterator begin() const { return m_dense.begin(); }
+    std::vector<Entity>::const_iterator end() const { return m_dense.end(); }
+
+private:
+    uint32_t& sparseSlot(Entity entity)
+    {
+        const size_t page = entityIndex(entity) / PAGE_SIZE;
+        if (page >= m_sparse_pages.size()) {
+            m_sparse_pages.resize(page + 1);
+        }
+        if (m_sparse_pages[page] == nullptr) {
+            m_sparse_pages[page] = std::make_unique<uint32_t[]>(PAGE_SIZE);
+            std::fill_n(m_sparse_pages[page].get(), PAGE_SIZE, NULL_INDEX);
+        }
+        return m_sparse_pages[page][entityIndex(entity) % PAGE_SIZE];
+    }
+};
+
+// Allows the scene to add and remove components without knowing their type
+class ISparseSet {
+public:
+    virtual ~ISparseSet() = default;
+
+    virtual bool contains(Entity entity) const = 0;
+    // moves the component at 'src' into the set then destroys 'src'
+    virtual void insertRelocate(Entity entity, void* src) = 0;
+    // copies the component at 'src' into the set. The component type must be copy constructible.
+    virtual void insertCopy(Entity entity, const void* src) = 0;
+    virtual void remove(Entity entity) = 0;
+    // returns nullptr if the entity doesn't have a component in this set
+    virtual ComponentTicks* getTicks(Entity entity) = 0;
+    // type-erased get(), returns nullptr if the entity doesn't have a component in this set
+    virtual void* getComponent(Entity entity) = 0;
+    virtual const EntitySet& getEntities() const = 0;
+};
+
+/*
+ * Stores components tightly packed in insertion order, alongside an EntitySet of their owners.
+ * Memory use is proportional to the number of components, not to the highest entity id.
+ */
+template <typename T>
+class SparseSet : public ISparseSet {
+    EntitySet m_entities{};
+    std::vector<T> m_dense_components{};
+    std::vector<ComponentTicks> m_dense_ticks{}; // parallel to m_dense_components
+
+public:
+    bool contains(Entity entity) const override { return m_entities.contains(entity); }
+
+    // returns nullptr if the entity doesn't have a component in this set
+    T* get(Entity entity)
+    {
+        const uint32_t index = m_entities.indexOf(entity);
+        if (index == EntitySet::NULL_INDEX) return nullptr;
+        return &m_dense_components[index];
+    }
+
+    T* insert(Entity entity, T&& component)
+    {
+        m_entities.insert(entity);
+        m_dense_components.push_back(std::move(component));
+        m_dense_ticks.push_back(ComponentTicks{0, 0});
+        return &m_dense_components.back();
+    }
+
+    void insertRelocate(Entity entity, void* src) override
+    {
+        insert(entity, std::move(*static_cast<T*>(src)));
+        static_cast<T*>(src)->~T();
+    }
+
+    void insertCopy(Entity entity, const void* src) override
+    {
+        if constexpr (std::is_copy_constructible_v<T>) {
+            insert(entity, T(*static_cast<const T*>(src)));
+        }
+        else {
+            (void)entity;
+            (void)src;
+            assert(false && "Copying a component type that isn't copy constructible.");
+        }
+    }
+
+    void remove(Entity entity) override
+    {
+        // mirror the swap-and-pop done by the entity set
+        const uint32_t index = m_entities.erase(entity);
+        if (index != m_dense_components.size() - 1) {
+            m_dense_components[index] = std::move(m_dense_components.back());
+            m_dense_ticks[index] = m_dense_ticks.back();
+        }
+        m_dense_components.pop_back();
+        m_dense_ticks.pop_back();
+    }
+
+    void* getComponent(Entity entity) override { return get(entity); }
+
+    ComponentTicks* getTicks(Entity entity) override
+    {
+        const uint32_t index = m_entities.indexOf(entity);
+        if (index == EntitySet::NULL_INDEX) return nullptr;
+        return &m_dense_ticks[index];
+    }
+
+    size_t size() const { return m_entities.size(); }
+
+    // getEntities()[i] owns getComponents()[i]
+    const EntitySet& getEntities() const override { return m_entities; }
+    T* getComponents() { return m_dense_components.data(); }
+
+    // iteration over the dense component array
+    typename std::vector<T>::iterator begin() { return m_dense_components.begin(); }
+    typename std::vector<T>::iterator end() { return m_dense_components.end(); }
+};
+
+} // namespace engine
@@ -4,6 +4,22 @@
 
 namespace engine {
 
+/*
+ * The low bits of an entity are an index into the scene's entity storage.
+ * The high bits are a generation counter that increments when the index is recycled,
+ * so handles to destroyed entities can be told apart from new entities reusing the same index.
+ * 0 is never a valid entity.
+ */
 using Entity = uint32_t;
 
-}
\ No newline at end of file
+constexpr uint32_t ENTITY_INDEX_BITS = 20; // up to ~1M live entities
+constexpr uint32_t ENTITY_INDEX_MASK = (1u << ENTITY_INDEX_BITS) - 1u;
+constexpr uint32_t ENTITY_GENERATION_MASK = (1u << (32 - ENTITY_INDEX_BITS)) - 1u;
+
+constexpr uint32_t entityIndex(Entity entity) { return entity & ENTITY_INDEX_MASK; }
+
+constexpr uint32_t entityGeneration(Entity entity) { return entity >> ENTITY_INDEX_BITS; }
+
+constexpr Entity makeEntity(uint32_t index, uint32_t generation) { return ((generation & ENTITY_GENERATION_MASK) << ENTITY_INDEX_BITS) | (index & ENTITY_INDEX_MASK); }
+
+} // namespace engine
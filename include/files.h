@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 #include <memory>
@@ -15,4 +16,25 @@ std::unique_ptr<std::vector<uint8_t>> readBinaryFile(const std::string& path);
 // minimum. Output format is R8G8B8A8_UINT
 std::unique_ptr<std::vector<uint8_t>> readImageFile(const std::string& path, int& width, int& height);
 
+// A read-only view of a whole file mapped into memory. Pages are loaded by the OS as they are touched.
+class MappedFile {
+   public:
+    // throws std::runtime_error if the file can't be opened or mapped
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+   private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_handle_ = nullptr;
+    void* mapping_handle_ = nullptr;
+#endif
+};
+
 } // namespace engine
\ No newline at end of file
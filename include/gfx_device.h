@@ -46,6 +46,7 @@ public:
     void cmdPushConstants(gfx::DrawBuffer* draw_buffer, const gfx::Pipeline* pipeline, uint32_t offset, uint32_t size, const void* data);
     void cmdBindDescriptorSet(gfx::DrawBuffer* draw_buffer, const gfx::Pipeline* pipeline, const gfx::DescriptorSet* set, uint32_t set_number);
 
+    // Resources other than uniform buffers and the shadowmap can be created from any thread, including while rendering.
     gfx::Pipeline* createPipeline(const gfx::PipelineInfo& info);
     void destroyPipeline(const gfx::Pipeline* pipeline);
 
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace engine {
+
+class JobSystem; // forward-dec
+
+/*
+ * Counts jobs that haven't finished yet. Pass one to JobSystem::run() and then JobSystem::wait() on it.
+ * Jobs can also be queued to start once a counter reaches zero with JobSystem::runAfter().
+ * A counter must outlive every job counted by it.
+ */
+class JobCounter {
+    friend class JobSystem;
+
+    struct Continuation {
+        std::function<void()> job;
+        JobCounter* counter;
+    };
+
+    std::atomic<uint32_t> m_count{0};
+    std::mutex m_mutex{}; // protects m_continuations and m_exception
+    std::vector<Continuation> m_continuations{};
+    std::exception_ptr m_exception{}; // first exception thrown by a counted job
+
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+
+    ~JobCounter() = default;
+
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool isDone() const { return m_count.load(std::memory_order_acquire) == 0; }
+};
+
+struct JobSystemInfo {
+    unsigned int worker_count = 0; // 0 uses one worker per hardware thread, minus one for the main thread
+    bool pin_threads = false;      // pin worker N to core N. The main thread is left alone.
+};
+
+/*
+ * Runs jobs on a pool of worker threads.
+ * Each thread has its own deque of jobs. Threads take the newest job from their own deque, and steal the oldest job from others when theirs is empty.
+ * Threads waiting on a counter run other jobs until the counter reaches zero, so jobs may wait on jobs they queue.
+ * The thread that creates the job system counts as thread 0 and runs jobs while it waits.
+ * Other threads may queue jobs and wait on them, but they never run jobs themselves, so they can't pick up work meant for the game loop.
+ */
+class JobSystem {
+    struct Job {
+        std::function<void()> func;
+        JobCounter* counter;
+    };
+
+    struct JobQueue {
+        std::mutex mutex{};
+        std::deque<Job> jobs{};
+    };
+
+    std::vector<std::unique_ptr<JobQueue>> m_queues{}; // one per thread, m_queues[0] belongs to the owning thread
+    std::vector<std::thread> m_workers{};
+    std::atomic<size_t> m_queued_job_count{0};
+    std::mutex m_sleep_mutex{};
+    std::condition_variable m_wake_condition{};
+    std::atomic<bool> m_shutting_down{false};
+    std::atomic<unsigned int> m_next_external_queue{0}; // spreads jobs queued by outside threads over the workers
+
+public:
+    // getThreadIndex() of threads that aren't part of any job system
+    static constexpr unsigned int EXTERNAL_THREAD_INDEX = UINT_MAX;
+
+    explicit JobSystem(JobSystemInfo info = {});
+    JobSystem(const JobSystem&) = delete;
+
+    ~JobSystem();
+
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned int getWorkerCount() const { return static_cast<unsigned int>(m_workers.size()); }
+
+    // number of threads that run jobs, including the owning thread
+    unsigned int getThreadCount() const { return getWorkerCount() + 1; }
+
+    // Index of the calling thread in [0, getThreadCount()). Threads outside the job system return EXTERNAL_THREAD_INDEX.
+    // Useful for indexing per-thread buffers inside jobs.
+    static unsigned int getThreadIndex();
+
+    // Queues a job. If 'counter' isn't nullptr it is incremented now and decremented when the job finishes.
+    void run(std::function<void()> job, JobCounter* counter = nullptr);
+
+    // Queues a job once every job counted by 'dependency' has finished.
+    void runAfter(JobCounter& dependency, std::function<void()> job, JobCounter* counter = nullptr);
+
+    // Runs queued jobs until 'counter' reaches zero, then rethrows the first exception thrown by a counted job.
+    // Threads outside the job system only block until then.
+    void wait(JobCounter& counter);
+
+    /*
+     * Splits [0, count) into ranges of at most 'chunk_size' and calls func(size_t begin, size_t end) for each range across all threads.
+     * Returns once every range is done. A chunk_size of 0 picks one that gives each thread a few ranges.
+     */
+    template <typename Func>
+    void parallelFor(size_t count, size_t chunk_size, Func&& func)
+    {
+        if (count == 0) return;
+        if (chunk_size == 0) {
+            chunk_size = std::max<size_t>(1, count / (static_cast<size_t>(getThreadCount()) * 4));
+        }
+        if (count <= chunk_size || m_workers.empty()) {
+            func(size_t{0}, count);
+            return;
+        }
+
+        JobCounter counter{};
+        // the calling thread takes the first range itself
+        for (size_t begin = chunk_size; begin < count; begin += chunk_size) {
+            const size_t end = std::min(begin + chunk_size, count);
+            run([&func, begin, end]() { func(begin, end); }, &counter);
+        }
+        try {
+            func(size_t{0}, chunk_size);
+        }
+        catch (...) {
+            wait(counter); // the other ranges still reference 'func'
+            throw;
+        }
+        wait(counter);
+    }
+
+private:
+    // queues a job that has already been counted
+    void push(Job job);
+    void workerLoop(unsigned int thread_index);
+    // takes a job from this thread's deque or steals one from another thread, returns false if there are none
+    bool tryGetJob(unsigned int thread_index, Job& job);
+    void execute(Job& job);
+    void finishJob(JobCounter* counter);
+};
+
+} // namespace engine
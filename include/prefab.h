@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/ext/quaternion_float.hpp>
+#include <glm/vec3.hpp>
+
+#include "ecs_archetype.h"
+
+namespace engine {
+
+/*
+ * A copy of an entity subtree that can be instantiated any number of times with Scene::Instantiate().
+ * Made by Scene::CreatePrefab(). Components are copied, so resources such as meshes and materials are shared
+ * by every instance rather than loaded again. Components that aren't copy constructible, such as CustomComponent, are left out.
+ * The source subtree may be destroyed once the prefab has been made.
+ */
+class Prefab {
+    friend class Scene; // makes and instantiates prefabs
+
+public:
+    Prefab() = default;
+    Prefab(const Prefab&) = delete;
+    Prefab(Prefab&&) = default;
+
+    ~Prefab()
+    {
+        for (Column& column : m_columns) {
+            for (size_t i = 0; i < column.nodes.size(); ++i) {
+                column.info.destroy(column.data + i * column.info.size);
+            }
+        }
+    }
+
+    Prefab& operator=(const Prefab&) = delete;
+
+    // number of entities made by each instance
+    size_t getEntityCount() const { return m_nodes.size(); }
+
+private:
+    // one per entity, in hierarchy order so that parents come first. m_nodes[0] is the root.
+    struct Node {
+        std::string tag;
+        uint32_t parent; // index into m_nodes, unused for the root
+        glm::vec3 position;
+        glm::quat rotation;
+        glm::vec3 scale;
+        bool is_static;
+    };
+
+    // every copied component of one type, other than TransformComponent
+    struct Column {
+        size_t position; // signature position
+        ComponentTypeInfo info;
+        std::vector<uint32_t> nodes; // index into m_nodes of each component, ascending
+        std::byte* data;             // nodes.size() components, aligned within 'allocation'
+        std::unique_ptr<std::byte[]> allocation;
+    };
+
+    // nodes with the same components, which are created together in one archetype
+    struct Group {
+        Signature signature;
+        std::vector<uint32_t> nodes; // index into m_nodes, ascending
+    };
+
+    std::vector<Node> m_nodes{};
+    std::vector<Column> m_columns{};
+    std::vector<Group> m_groups{};
+};
+
+} // namespace engine
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include <glm/mat4x4.hpp>
@@ -44,11 +45,15 @@ public:
 
     const gfx::DescriptorSetLayout* GetMaterialSetLayout() { return material_set_layout; }
 
-    std::unordered_map<gfx::SamplerInfo, const gfx::Sampler*> samplers;
+    // shared by every texture with the same SamplerInfo. Safe to call from any thread, as scenes may be loaded on other threads.
+    const gfx::Sampler* GetOrCreateSampler(const gfx::SamplerInfo& info);
 
 private:
     std::unique_ptr<GFXDevice> device_;
 
+    std::unordered_map<gfx::SamplerInfo, const gfx::Sampler*> samplers_;
+    std::mutex samplers_mutex_{}; // protects samplers_
+
     struct CameraSettings {
         float vertical_fov_radians = glm::radians(70.0f);
         float clip_near = 0.1f;
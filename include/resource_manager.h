@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -25,6 +26,7 @@ class ResourceManager : public IResourceManager {
 
     std::shared_ptr<T> Add(const std::string& name, std::unique_ptr<T>&& resource)
     {
+        std::lock_guard lock(mutex_);
         if (resources_.contains(name) == false) {
             std::shared_ptr<T> resource_shared(std::move(resource));
             resources_.emplace(name, resource_shared);
@@ -35,10 +37,16 @@ class ResourceManager : public IResourceManager {
         }
     }
 
-    void AddPersistent(const std::string& name, std::unique_ptr<T>&& resource) { persistent_resources_.push_back(Add(name, std::move(resource))); }
+    void AddPersistent(const std::string& name, std::unique_ptr<T>&& resource)
+    {
+        std::shared_ptr<T> resource_shared = Add(name, std::move(resource));
+        std::lock_guard lock(mutex_);
+        persistent_resources_.push_back(std::move(resource_shared));
+    }
 
     std::shared_ptr<T> Get(const std::string& name)
     {
+        std::lock_guard lock(mutex_);
         if (resources_.contains(name)) {
             std::weak_ptr<T> ptr = resources_.at(name);
             if (ptr.expired() == false) {
@@ -54,6 +62,7 @@ class ResourceManager : public IResourceManager {
     }
 
    private:
+    std::mutex mutex_{}; // scenes may be loaded on other threads
     std::unordered_map<std::string, std::weak_ptr<T>> resources_{};
     // This array owns persistent resources
     std::vector<std::shared_ptr<T>> persistent_resources_{};
@@ -31,6 +31,9 @@ public:
     void setOcclusionRoughnessMetallicTexture(std::shared_ptr<Texture> texture);
     const gfx::DescriptorSet* getDescriptorSet() { return m_material_set; }
     Shader* getShader() { return m_shader.get(); }
+
+    // identifies the shader and textures, so equal materials loaded separately share a hash
+    uint64_t getContentHash() const;
 };
 
 } // namespace engine
\ No newline at end of file
@@ -25,6 +25,7 @@ class Mesh {
     const gfx::Buffer* m_vb;
     const gfx::Buffer* m_ib;
     uint32_t m_count;
+    uint64_t m_content_hash; // of the vertex and index data
 
 public:
     Mesh(GFXDevice* gfx, const std::vector<Vertex>& vertices);
@@ -38,6 +39,7 @@ public:
     const gfx::Buffer* getVB();
     const gfx::Buffer* getIB();
     uint32_t getCount();
+    uint64_t getContentHash() const { return m_content_hash; }
 
 private:
     void initMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
@@ -33,11 +33,13 @@ class Shader {
 
     const gfx::Pipeline* GetPipeline();
     int GetRenderOrder() { return render_order_; }
+    uint64_t GetContentHash() const { return content_hash_; }
 
    private:
     GFXDevice* const gfx_;
     const gfx::Pipeline* pipeline_;
     const int render_order_;
+    uint64_t content_hash_; // of the shader paths and settings
 };
 
 } // namespace engine
\ No newline at end of file
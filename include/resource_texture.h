@@ -17,11 +17,13 @@ class Texture {
 
     const gfx::Image* GetImage() { return image_; }
     const gfx::Sampler* GetSampler() { return sampler_; }
+    uint64_t GetContentHash() const { return content_hash_; }
 
    private:
     GFXDevice* gfx_;
     const gfx::Image* image_;
     const gfx::Sampler* sampler_; // not owned by Texture, owned by Renderer
+    uint64_t content_hash_;       // of the bitmap and sampling settings
 };
 
 std::unique_ptr<Texture> LoadTextureFromFile(const std::string& path, gfx::SamplerInfo samplerInfo, Renderer* renderer, bool srgb = true);
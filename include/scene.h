@@ -2,20 +2,39 @@
 
 #include <cassert>
 #include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <iterator>
 #include <map>
+#include <new>
 #include <stdexcept>
-#include <typeinfo>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 
 #include <glm/vec3.hpp>
 #include <glm/ext/quaternion_float.hpp>
 
 #include "ecs.h"
+#include "ecs_archetype.h"
+#include "ecs_command_buffer.h"
+#include "ecs_sparse_set.h"
 #include "event_system.h"
 #include "component_transform.h"
+#include "job_system.h"
+#include "prefab.h"
 
 namespace engine {
 
 class Application;
+struct SnapshotResources;
+
+template <typename... Ts>
+class SceneView;
 
 class Scene {
    public:
@@ -24,48 +43,220 @@ class Scene {
     Scene& operator=(const Scene&) = delete;
     ~Scene();
 
+    // 'ts' is the frame time. With a fixed timestep, systems run for as many whole steps as have built up.
     void Update(float ts);
 
+    /*
+     * Makes Update() run every system in steps of 'step' seconds, at most 'max_steps_per_frame' times per frame.
+     * Time beyond that is dropped so that a slow frame can't make the next one slower still.
+     * Edge-triggered input such as Window::GetKeyPress() may be seen by no step, or by several, in a frame.
+     * 0 (the default) runs one step per frame with the frame time.
+     */
+    void SetFixedTimestep(float step, uint32_t max_steps_per_frame = 8)
+    {
+        assert(step >= 0.0f && max_steps_per_frame > 0);
+        fixed_timestep_ = step;
+        max_steps_per_frame_ = max_steps_per_frame;
+        step_accumulator_ = 0.0f;
+    }
+    float GetFixedTimestep() const { return fixed_timestep_; }
+
+    // How far the frame is between the previous and the latest step, from 0 to 1, for interpolating what is rendered.
+    // Always 1 without a fixed timestep.
+    float GetInterpolationAlpha() const { return (fixed_timestep_ > 0.0f) ? step_accumulator_ / fixed_timestep_ : 1.0f; }
+
     Application* app() { return app_; }
 
     EventSystem* event_system() { return event_system_.get(); }
 
+    // nullptr if the scene has no application or is still being preloaded. Systems then update one at a time.
+    JobSystem* job_system() { return job_system_; }
+
     /* ecs stuff */
 
     Entity CreateEntity(const std::string& tag, Entity parent = 0, const glm::vec3& pos = glm::vec3{0.0f, 0.0f, 0.0f},
                         const glm::quat& rot = glm::quat{1.0f, 0.0f, 0.0f, 0.0f}, const glm::vec3& scl = glm::vec3{1.0f, 1.0f, 1.0f});
 
+    /*
+     * Creates 'count' entities under 'parent', each with a TransformComponent and value-initialised Ts.
+     * Entity storage is reserved once, every entity is placed straight into its final archetype, and systems are updated in one pass.
+     * init(size_t i, Entity entity, TransformComponent& transform, Ts&... components) is called for each entity before systems see it,
+     * to set its tag (with InternTag()), transform and components. The transform starts out like CreateEntity()'s defaults. Don't change transform.parent in init.
+     */
+    template <typename... Ts, typename Func>
+    std::vector<Entity> CreateEntities(size_t count, Entity parent, Func&& init)
+    {
+        std::vector<Entity> entities(count, 0);
+        if (count == 0) return entities;
+
+        Signature signature{};
+        for (size_t position : {getComponentTypeId<TransformComponent>(), getComponentTypeId<Ts>()...}) {
+            assert(registered_components_.test(position) && "Creating entities with a component type that isn't registered.");
+            assert(signature.test(position) == false && "Creating entities with the same component type twice.");
+            signature.set(position);
+        }
+
+        AllocateEntities(count, signature, entities.data());
+        for (size_t i = 0; i < count; ++i) {
+            const Entity entity = entities[i];
+            TransformComponent* t = ConstructComponent<TransformComponent>(entity);
+            t->rotation = glm::quat{1.0f, 0.0f, 0.0f, 0.0f};
+            t->position = glm::vec3{0.0f, 0.0f, 0.0f};
+            t->scale = glm::vec3{1.0f, 1.0f, 1.0f};
+            t->parent = parent;
+            t->is_static = false;
+            init(i, entity, *t, *ConstructComponent<Ts>(entity)...);
+            assert(t->parent == parent && "Changing the parent of an entity while it is being created.");
+        }
+        FinishCreatingEntities(entities.data(), count, parent, signature);
+
+        return entities;
+    }
+
+    /*
+     * Returns the entity with the given tag directly under 'parent' (0 for root entities), or 0 if there isn't one.
+     * Constant time, as the scene keeps entities indexed by parent and tag.
+     * Take care not to create multiple entities under a parent with the same tag, as it's unspecified which one is returned.
+     */
     Entity GetEntity(const std::string& tag, Entity parent = 0);
 
-    size_t GetComponentSignaturePosition(size_t hash);
+    // Copies an entity and its descendants into a prefab (see prefab.h)
+    Prefab CreatePrefab(Entity root);
+
+    /*
+     * Creates a copy of a prefab's entities and returns the copy of its root.
+     * The root is placed under 'parent' with the given transform, like CreateEntity(). Its descendants keep their transforms relative to it.
+     */
+    Entity Instantiate(const Prefab& prefab, Entity parent = 0, const glm::vec3& pos = glm::vec3{0.0f, 0.0f, 0.0f},
+                       const glm::quat& rot = glm::quat{1.0f, 0.0f, 0.0f, 0.0f}, const glm::vec3& scl = glm::vec3{1.0f, 1.0f, 1.0f});
+
+    // Renames an entity. Use this instead of assigning TransformComponent::tag_id so that GetEntity() can find it.
+    void SetEntityTag(Entity entity, const std::string& tag);
+
+    const std::string& GetEntityTag(Entity entity) { return tag_names_[ReadComponent<TransformComponent>(entity)->tag_id]; }
+
+    // Id of a tag in this scene's tag table, adding it if it's new. Ids aren't shared between scenes. Id 0 is the empty tag.
+    uint32_t InternTag(const std::string& tag);
+
+    // the reference stays valid for the scene's lifetime
+    const std::string& GetTagName(uint32_t tag_id) const { return tag_names_[tag_id]; }
+
+    // Moves an entity under another parent (0 for none). Use this instead of assigning TransformComponent::parent.
+    // The new parent must not be the entity itself or one of its descendants.
+    void SetEntityParent(Entity entity, Entity parent);
+
+    // 0 for root entities
+    Entity GetEntityParent(Entity entity) const { return hierarchy_[entityIndex(entity)].parent; }
+
+    // number of ancestors, 0 for root entities
+    uint32_t GetEntityDepth(Entity entity) const { return hierarchy_[entityIndex(entity)].depth; }
+
+    // Changes whenever an entity is moved to another parent with SetEntityParent(), so that anything laid out by hierarchy knows to rebuild.
+    // Creating and destroying entities don't change it, systems see those through onComponentInsert() and onComponentRemove().
+    uint64_t GetReparentVersion() const { return reparent_version_; }
+
+    // Calls func(Entity) for each direct child of 'parent' in the order they were parented. Pass 0 to visit the root entities.
+    // Don't create, destroy or reparent entities from func.
+    template <typename Func>
+    void ForEachChild(Entity parent, Func&& func)
+    {
+        for (Entity child = hierarchy_[entityIndex(parent)].first_child; child != 0;) {
+            const Entity next = hierarchy_[entityIndex(child)].next_sibling;
+            func(child);
+            child = next;
+        }
+    }
+
+    /*
+     * Calls func(Entity) for every descendant of 'root' depth-first, so parents are always visited before their children.
+     * 'root' itself isn't visited. Pass 0 to visit every entity in the scene.
+     * Don't create, destroy or reparent entities from func.
+     */
+    template <typename Func>
+    void ForEachDescendant(Entity root, Func&& func)
+    {
+        Entity entity = hierarchy_[entityIndex(root)].first_child;
+        while (entity != 0) {
+            func(entity);
+            const HierarchyNode* node = &hierarchy_[entityIndex(entity)];
+            if (node->first_child != 0) {
+                entity = node->first_child;
+                continue;
+            }
+            // climb until there's a sibling to move on to
+            while (node->next_sibling == 0) {
+                if (node->parent == root) return;
+                node = &hierarchy_[entityIndex(node->parent)];
+            }
+            entity = node->next_sibling;
+        }
+    }
+
+    // Destroys the entity, its children, and all of their components. Handles to destroyed entities become invalid.
+    void DestroyEntity(Entity entity);
+
+    // false for destroyed entities, even if their index has been reused
+    bool IsEntityValid(Entity entity) const
+    {
+        const uint32_t index = entityIndex(entity);
+        return index != 0 && index < entity_locations_.size() && entity_locations_[index].generation == entityGeneration(entity);
+    }
+
+    bool IsComponentRegistered(size_t component_id) const { return registered_components_.test(component_id); }
 
     template <typename T>
-    void RegisterComponent()
+    void RegisterComponent(ComponentStorage storage = ComponentStorage::ARCHETYPE)
     {
-        size_t hash = typeid(T).hash_code();
-        assert(component_arrays_.contains(hash) == false && "Registering component type more than once.");
-        component_arrays_.emplace(hash, std::make_unique<ComponentArray<T>>());
+        const size_t signature_position = getComponentTypeId<T>();
+        assert(registered_components_.test(signature_position) == false && "Registering component type more than once.");
 
-        size_t signature_position = next_signature_position_;
-        ++next_signature_position_;
-        assert(signature_position < MAX_COMPONENTS && "Registering too many components!");
-        assert(component_signature_positions_.contains(hash) == false);
-        component_signature_positions_.emplace(hash, signature_position);
+        registered_components_.set(signature_position);
+        component_infos_[signature_position] = makeComponentTypeInfo<T>();
+        if (storage == ComponentStorage::SPARSE_SET) {
+            sparse_sets_[signature_position] = std::make_unique<SparseSet<T>>();
+        }
+        else {
+            archetype_mask_.set(signature_position);
+        }
     }
 
+    // Returns nullptr if the entity doesn't have the component. Marks the component as changed, use ReadComponent() when only reading.
     template <typename T>
     T* GetComponent(Entity entity)
     {
-        // check if component exists on entity:
-        size_t hash = typeid(T).hash_code();
-        size_t signature_position = component_signature_positions_.at(hash);
-        const auto& entity_signature = signatures_.at(entity);
-        if (entity_signature.test(signature_position) == false) {
-            return nullptr;
-        }
+        ComponentTicks* ticks = nullptr;
+        T* component = LookupComponent<T>(entity, &ticks);
+        if (component) ticks->changed = change_tick_;
+        return component;
+    }
+
+    // Returns nullptr if the entity doesn't have the component. Doesn't affect change tracking.
+    template <typename T>
+    const T* ReadComponent(Entity entity)
+    {
+        return LookupComponent<T>(entity, nullptr);
+    }
 
-        auto array = GetComponentArray<T>();
-        return array->getData(entity);
+    // Returns nullptr if the entity doesn't have the component
+    template <typename T>
+    const ComponentTicks* GetComponentTicks(Entity entity)
+    {
+        ComponentTicks* ticks = nullptr;
+        LookupComponent<T>(entity, &ticks);
+        return ticks;
+    }
+
+    // Advances after every stage of systems. Components added or written now are stamped with this tick.
+    uint32_t GetChangeTick() const { return change_tick_; }
+
+    // Returns the pool of a component registered with ComponentStorage::SPARSE_SET.
+    // Systems may iterate it directly instead of looking up each entity.
+    template <typename T>
+    SparseSet<T>* GetSparseSet()
+    {
+        const size_t signature_position = getComponentTypeId<T>();
+        assert(sparse_sets_[signature_position] != nullptr && "Component is not stored in a sparse set.");
+        return static_cast<SparseSet<T>*>(sparse_sets_[signature_position].get());
     }
 
     // because GetComponent<Transformzzzzzz takes too long
@@ -80,96 +271,651 @@ class Scene {
     template <typename T>
     T* AddComponent(Entity entity, T&& comp = T{})
     {
-        size_t hash = typeid(T).hash_code();
-
-        auto array = GetComponentArray<T>();
-        array->insertData(entity, std::move(comp)); // errors if entity already exists in array
-
         // set the component bit for this entity
-        size_t signature_position = component_signature_positions_.at(hash);
-        auto& signature_ref = signatures_.at(entity);
+        const size_t signature_position = getComponentTypeId<T>();
+        assert(registered_components_.test(signature_position) && "Adding component type that isn't registered.");
+        assert(IsEntityValid(entity) && "Adding component to a destroyed entity.");
+        Signature& signature_ref = signatures_[entityIndex(entity)];
+        assert(signature_ref.test(signature_position) == false && "Adding component to entity that already has it.");
         signature_ref.set(signature_position);
 
-        for (auto& [system_hash, system] : ecs_systems_) {
+        T* component = nullptr;
+        if (sparse_sets_[signature_position]) {
+            auto sparse_set = static_cast<SparseSet<T>*>(sparse_sets_[signature_position].get());
+            component = sparse_set->insert(entity, std::move(comp));
+            *sparse_set->getTicks(entity) = ComponentTicks{change_tick_, change_tick_};
+        }
+        else {
+            // move the entity into the archetype for its new signature and construct the component there
+            const EntityLocation& location = MoveEntityToArchetype(entity, GetArchetypeIndex(signature_ref & archetype_mask_));
+            void* component_memory = archetypes_[location.archetype]->getComponent(location.row, signature_position);
+            component = new (component_memory) T(std::move(comp));
+            *archetypes_[location.archetype]->getTicks(location.row, signature_position) = ComponentTicks{change_tick_, change_tick_};
+        }
+
+        for (auto& [system_id, system] : ecs_systems_) {
             if (system->m_entities.contains(entity)) continue;
-            if ((system->m_signature & signature_ref) == system->m_signature) {
+            if (system->m_signature.isSubsetOf(signature_ref)) {
                 system->m_entities.insert(entity);
                 system->onComponentInsert(entity);
             }
         }
 
-        return array->getData(entity);
+        return component;
+    }
+
+    template <typename T>
+    void RemoveComponent(Entity entity)
+    {
+        RemoveComponentAtPosition(entity, getComponentTypeId<T>());
+    }
+
+    /*
+     * Returns the calling thread's command buffer. Systems and custom behaviours use it to create or destroy entities
+     * and add or remove components while the scene is being iterated, including from jobs.
+     * The buffers are played back after each stage of systems in Update().
+     * Threads outside the scene's job system share the buffer of the thread that owns the job system.
+     */
+    EntityCommandBuffer& GetCommandBuffer();
+
+    // Applies every command in 'commands' now and clears it. Must not be called while the scene is being iterated.
+    void PlaybackCommands(EntityCommandBuffer& commands);
+
+    /*
+     * Writes every entity to a binary snapshot file (see scene_snapshot.h). Transforms and mesh renderables are saved,
+     * along with every other component type that is trivially copyable. Other components, such as CustomComponent, are not.
+     * Meshes and materials are saved as their content hashes, not their data.
+     * Snapshots can only be loaded by the same build of the engine.
+     */
+    void SaveSnapshot(const std::string& path);
+
+    // Memory-maps a snapshot written by SaveSnapshot() and adds its entities to the scene, copying component data straight out of the file.
+    // Throws std::runtime_error if the file is invalid or refers to a component type, mesh or material that isn't available.
+    void LoadSnapshot(const std::string& path, const SnapshotResources& resources);
+
+    /*
+     * Returns a view of every entity that has all of the components Ts. Components may be archetype or sparse set stored.
+     * Use view.each(func) or range-for with structured bindings: for (auto [entity, transform, renderable] : View<...>())
+     * Ts may be const to request read-only access.
+     */
+    template <typename... Ts>
+    SceneView<Ts...> View()
+    {
+        return SceneView<Ts...>(this);
+    }
+
+    /*
+     * Calls func(size_t count, const Entity* entities, Ts* components...) for every archetype chunk containing all of the given components.
+     * Each pointer is a contiguous column of 'count' elements. Adding components to entities during iteration is not allowed.
+     * Only components stored in archetypes can be iterated this way.
+     */
+    template <typename... Ts, typename Func>
+    void ForEachChunk(Func&& func)
+    {
+        const std::array<size_t, sizeof...(Ts)> positions{getComponentTypeId<Ts>()...};
+        Signature required{};
+        for (size_t position : positions) {
+            required.set(position);
+        }
+        assert(required.isSubsetOf(archetype_mask_) && "ForEachChunk() can't iterate sparse set components.");
+
+        for (const auto& archetype : archetypes_) {
+            if (required.isSubsetOf(archetype->getSignature()) == false) continue;
+            for (size_t chunk = 0; chunk < archetype->getChunkCount(); ++chunk) {
+                [&]<size_t... Is>(std::index_sequence<Is...>) {
+                    func(archetype->getChunkSize(chunk), static_cast<const Entity*>(archetype->getChunkEntities(chunk)),
+                         static_cast<Ts*>(archetype->getChunkColumn(chunk, positions[Is]))...);
+                }(std::index_sequence_for<Ts...>{});
+            }
+        }
     }
 
     template <typename T>
     void RegisterSystem()
     {
-        size_t hash = typeid(T).hash_code();
-        ecs_systems_.emplace_back(hash, std::make_unique<T>(this));
+        RegisterSystemAtIndex<T>(ecs_systems_.size());
     }
 
     /* Pushes old systems starting at 'index' along by 1 */
     template <typename T>
     void RegisterSystemAtIndex(size_t index)
     {
-        size_t hash = typeid(T).hash_code();
-        ecs_systems_.emplace(ecs_systems_.begin() + index, hash, std::make_unique<T>(this));
+        const size_t system_id = getSystemTypeId<T>();
+        if (system_id >= systems_by_id_.size()) {
+            systems_by_id_.resize(system_id + 1, nullptr);
+        }
+        assert(systems_by_id_[system_id] == nullptr && "Registering system more than once.");
+
+        auto system = std::make_unique<T>(this);
+        assert(system->m_signature.isSubsetOf(registered_components_) && "System requires a component that isn't registered.");
+        systems_by_id_[system_id] = system.get();
+        ecs_systems_.emplace(ecs_systems_.begin() + index, system_id, std::move(system));
+        system_stages_dirty_ = true;
     }
 
     template <typename T>
     T* GetSystem()
     {
-        size_t hash = typeid(T).hash_code();
-        System* found_system = nullptr;
-        for (auto& [system_hash, system] : ecs_systems_) {
-            if (hash == system_hash) found_system = system.get();
-        }
-        if (found_system == nullptr) {
+        const size_t system_id = getSystemTypeId<T>();
+        if (system_id >= systems_by_id_.size() || systems_by_id_[system_id] == nullptr) {
             throw std::runtime_error("Unable to find system");
         }
-        T* casted_ptr = dynamic_cast<T*>(found_system);
-        if (casted_ptr == nullptr) {
-            throw std::runtime_error("Failed to cast system pointer!");
-        }
-        return casted_ptr;
+        // systems_by_id_[getSystemTypeId<T>()] is always a T
+        return static_cast<T*>(systems_by_id_[system_id]);
     }
 
    private:
+    template <typename... Ts>
+    friend class SceneView;
+    friend class SceneManager; // moves preloaded scenes onto the job system
+
     Application* const app_;
+    JobSystem* job_system_ = nullptr;
 
-   public:
-    Entity next_entity_id_ = 1; // 0 is not a valid entity
-   private:
     uint64_t framecount_ = 0;
+    // starts above 0 so that everything counts as changed for systems that haven't run yet
+    uint32_t change_tick_ = 1;
 
-    /* ecs stuff */
+    float fixed_timestep_ = 0.0f;
+    uint32_t max_steps_per_frame_ = 8;
+    float step_accumulator_ = 0.0f; // time not yet simulated, less than one step after Update()
 
-    size_t next_signature_position_ = 0;
-    // maps component hashes to signature positions
-    std::unordered_map<size_t, size_t> component_signature_positions_{};
-    // maps entity ids to their signatures
-    std::unordered_map<Entity, std::bitset<MAX_COMPONENTS>> signatures_{};
-    // maps component hashes to their arrays
-    std::unordered_map<size_t, std::unique_ptr<IComponentArray>> component_arrays_{};
+    /* ecs stuff */
 
-    // hashes and associated systems
+    // Signature positions are component ids from getComponentTypeId(), which are shared by all scenes.
+    Signature registered_components_{};
+    // type-erased component operations, indexed by signature position
+    std::vector<ComponentTypeInfo> component_infos_ = std::vector<ComponentTypeInfo>(MAX_COMPONENTS);
+    // pools for components using ComponentStorage::SPARSE_SET, nullptr for archetype components. Indexed by signature position
+    std::vector<std::unique_ptr<ISparseSet>> sparse_sets_ = std::vector<std::unique_ptr<ISparseSet>>(MAX_COMPONENTS);
+    // the components that are stored in archetypes
+    Signature archetype_mask_{};
+    // the components each entity has, indexed by entity index
+    std::vector<Signature> signatures_{};
+
+    struct EntityLocation {
+        uint32_t archetype; // index into archetypes_
+        uint32_t row;
+        uint32_t generation; // current generation of this entity index
+    };
+    // indexed by entity index
+    std::vector<EntityLocation> entity_locations_{};
+    // indices of destroyed entities, reused before new indices are made
+    std::vector<uint32_t> free_entity_indices_{};
+    // component storage, archetypes_[0] is the archetype with no components
+    std::vector<std::unique_ptr<Archetype>> archetypes_{};
+    // maps signatures to indices into archetypes_
+    std::unordered_map<Signature, uint32_t> archetype_indices_{};
+
+    // Parent/child links of each entity, mirroring TransformComponent::parent.
+    // Children are a doubly linked list so that they can be unlinked in constant time.
+    struct HierarchyNode {
+        Entity parent;
+        Entity first_child;
+        Entity last_child;
+        Entity prev_sibling;
+        Entity next_sibling;
+        uint32_t depth;
+    };
+    // indexed by entity index, hierarchy_[0] holds the root entities as its children
+    std::vector<HierarchyNode> hierarchy_{};
+    uint64_t reparent_version_ = 0;
+
+    // interned entity tags, never removed
+    std::unordered_map<std::string, uint32_t> tag_ids_{};
+    std::deque<std::string> tag_names_{}; // indexed by tag id. A deque, so references to names stay valid as tags are added.
+    // EntityNameKey(parent, tag id) -> entities with that tag under that parent
+    std::unordered_multimap<uint64_t, Entity> entity_names_{};
+
+    // system ids and associated systems, in update order
     std::vector<std::pair<size_t, std::unique_ptr<System>>> ecs_systems_{};
+    // indexed by system id from getSystemTypeId(), nullptr for systems not in this scene
+    std::vector<System*> systems_by_id_{};
+    // Systems grouped by dependency depth. Systems in the same stage don't conflict and are updated concurrently.
+    std::vector<std::vector<System*>> system_stages_{};
+    bool system_stages_dirty_ = true;
+    // indexed by JobSystem::getThreadIndex(), one buffer if there is no job system
+    std::vector<std::unique_ptr<EntityCommandBuffer>> command_buffers_{};
+
+    // returns nullptr if the entity doesn't have the component. Also finds the component's ticks if 'ticks' isn't nullptr.
+    template <typename T>
+    T* LookupComponent(Entity entity, ComponentTicks** ticks)
+    {
+        const size_t signature_position = getComponentTypeId<T>();
+        assert(registered_components_.test(signature_position) && "Getting component type that isn't registered.");
+        assert(IsEntityValid(entity) && "Getting component of a destroyed entity.");
+        if (sparse_sets_[signature_position]) {
+            auto sparse_set = static_cast<SparseSet<T>*>(sparse_sets_[signature_position].get());
+            if (ticks) *ticks = sparse_set->getTicks(entity);
+            return sparse_set->get(entity);
+        }
+        const EntityLocation& location = entity_locations_[entityIndex(entity)];
+        Archetype* archetype = archetypes_[location.archetype].get();
+        if (ticks) *ticks = archetype->getTicks(location.row, signature_position);
+        return static_cast<T*>(archetype->getComponent(location.row, signature_position));
+    }
+
+    // adds an entity to the end of its parent's children and sets its depth, or removes it from its parent's children
+    void LinkToParent(Entity entity, Entity parent);
+    void UnlinkFromParent(Entity entity);
+
+    static uint64_t EntityNameKey(Entity parent, uint32_t tag_id) { return (static_cast<uint64_t>(parent) << 32) | tag_id; }
+    // adds or removes an entity from entity_names_
+    void IndexEntityName(Entity entity, Entity parent, uint32_t tag_id);
+    void UnindexEntityName(Entity entity, Entity parent, uint32_t tag_id);
 
+    // Gives 'count' new entities ids and rows in the archetype for 'signature', and writes the ids to 'entities'.
+    // Components are left unconstructed, use ConstructComponent() for each, then FinishCreatingEntities().
+    void AllocateEntities(size_t count, const Signature& signature, Entity* entities);
+    // links new entities under 'parent', indexes their names, and adds them to systems
+    void FinishCreatingEntities(const Entity* entities, size_t count, Entity parent, const Signature& signature);
+    // adds new entities that all have 'signature' to the systems that need them, checking each system once
+    void AddNewEntitiesToSystems(const Entity* entities, size_t count, const Signature& signature);
+
+    // value-initialises a component of an entity from AllocateEntities()
     template <typename T>
-    ComponentArray<T>* GetComponentArray()
+    T* ConstructComponent(Entity entity)
     {
-        size_t hash = typeid(T).hash_code();
-        auto it = component_arrays_.find(hash);
-        if (it == component_arrays_.end()) {
-            throw std::runtime_error("Cannot find component array.");
+        const size_t signature_position = getComponentTypeId<T>();
+        if (sparse_sets_[signature_position]) {
+            auto sparse_set = static_cast<SparseSet<T>*>(sparse_sets_[signature_position].get());
+            T* component = sparse_set->insert(entity, T{});
+            *sparse_set->getTicks(entity) = ComponentTicks{change_tick_, change_tick_};
+            return component;
         }
-        auto ptr = it->second.get();
-        auto casted_ptr = dynamic_cast<ComponentArray<T>*>(ptr);
-        assert(casted_ptr != nullptr);
-        return casted_ptr;
+        const EntityLocation& location = entity_locations_[entityIndex(entity)];
+        Archetype* archetype = archetypes_[location.archetype].get();
+        T* component = new (archetype->getComponent(location.row, signature_position)) T{};
+        *archetype->getTicks(location.row, signature_position) = ComponentTicks{change_tick_, change_tick_};
+        return component;
     }
 
+    // returns nullptr if the entity doesn't have the component
+    void* GetComponentAtPosition(Entity entity, size_t signature_position);
+
+    struct ComponentSource {
+        size_t position;
+        void* data;
+    };
+    // Adds components the entity doesn't have yet, moving it to its new archetype once.
+    // With copy = false each source is relocated into the scene, except trivially copyable components which are only read.
+    // With copy = true every source is copy-constructed and left intact.
+    void AddComponentsAtPositions(Entity entity, const std::vector<ComponentSource>& components, bool copy);
+
+    // finds or creates the archetype for a signature
+    uint32_t GetArchetypeIndex(const Signature& signature);
+    // moves all of an entity's existing components into another archetype
+    const EntityLocation& MoveEntityToArchetype(Entity entity, uint32_t archetype_index);
+    void RemoveComponentAtPosition(Entity entity, size_t signature_position);
+    // Only while the scene isn't updating and no commands are recorded. nullptr makes systems update one at a time.
+    void SetJobSystem(JobSystem* job_system);
+    // builds the dependency graph of ecs_systems_ from their declared component access
+    void BuildSystemStages();
+    // runs every system once
+    void Step(float ts);
+    // applies one entity's commands from a command buffer, in recorded order
+    void PlaybackEntityCommands(Entity entity, const std::vector<EntityCommandBuffer::Command*>& commands);
+    // plays back command_buffers_ in thread order
+    void PlaybackCommandBuffers();
+
     std::unique_ptr<EventSystem> event_system_{};
 };
 
+/*
+ * Iterates every entity in a scene that has all of the components Ts, yielding the components directly.
+ * Walks whichever is smaller: the archetypes containing the archetype-stored Ts, or the smallest sparse set pool among Ts.
+ * Archetype components are read straight out of chunk columns.
+ * Non-const Ts are marked as changed on every entity visited. Use const Ts for components that are only read.
+ * Adding or removing entities or components while iterating is not allowed.
+ */
+template <typename... Ts>
+class SceneView {
+    static_assert(sizeof...(Ts) > 0, "A view needs at least one component type.");
+
+   public:
+    explicit SceneView(Scene* scene) : scene_(scene), positions_{getComponentTypeId<std::remove_const_t<Ts>>()...}
+    {
+        Signature archetype_required{};
+        for (size_t position : positions_) {
+            assert(scene_->registered_components_.test(position) && "Viewing component type that isn't registered.");
+            required_.set(position);
+            if (scene_->sparse_sets_[position]) {
+                has_sparse_components_ = true;
+                // the smallest sparse pool is a candidate for driving iteration
+                const EntitySet& entities = scene_->sparse_sets_[position]->getEntities();
+                if (driver_ == nullptr || entities.size() < driver_->size()) {
+                    driver_ = &entities;
+                }
+            }
+            else {
+                archetype_required.set(position);
+            }
+        }
+
+        // when every component is in a sparse set, the archetypes can't narrow anything down
+        if (archetype_required.none()) return;
+
+        size_t archetype_entity_count = 0;
+        for (const auto& archetype : scene_->archetypes_) {
+            if (archetype->size() != 0 && archetype_required.isSubsetOf(archetype->getSignature())) {
+                archetypes_.push_back(archetype.get());
+                archetype_entity_count += archetype->size();
+            }
+        }
+        if (driver_ != nullptr && archetype_entity_count <= driver_->size()) {
+            driver_ = nullptr; // the archetypes are smaller, walk those instead
+        }
+    }
+
+    // number of entities in each batch when a sparse set drives iteration
+    static constexpr size_t SPARSE_BATCH_SIZE = 256;
+
+    /*
+     * Skips entities whose T wasn't changed (Filter = Changed<T>) or added (Filter = Added<T>) after 'since_tick'. T must be one of Ts.
+     * Systems pass m_last_run_tick to visit what changed since they last ran. Every filter must pass.
+     */
+    template <typename Filter>
+    SceneView& where(uint32_t since_tick) &
+    {
+        constexpr size_t index = IndexOf<std::remove_const_t<typename TickFilterTraits<Filter>::Component>>();
+        static_assert(index < sizeof...(Ts), "where() filters must use one of the view's component types.");
+        assert(tick_filter_count_ < tick_filters_.size() && "Too many filters on one view.");
+        tick_filters_[tick_filter_count_++] = TickFilter{index, TickFilterTraits<Filter>::ADDED, since_tick};
+        return *this;
+    }
+
+    // returns by value so that range-for over View<...>().where<...>() doesn't refer to a destroyed view
+    template <typename Filter>
+    SceneView where(uint32_t since_tick) &&
+    {
+        where<Filter>(since_tick);
+        return std::move(*this);
+    }
+
+    // Calls func(Entity, Ts&...) or func(Ts&...) for every matching entity
+    template <typename Func>
+    void each(Func&& func)
+    {
+        const size_t batch_count = batchCount();
+        for (size_t batch = 0; batch < batch_count; ++batch) {
+            EachInBatch(batch, func);
+        }
+    }
+
+    /*
+     * Number of batches the matching entities are split into: one per archetype chunk, or one per SPARSE_BATCH_SIZE entities of the driving sparse set.
+     * Batches don't share entities, and the batch order matches the order each() visits entities in.
+     */
+    size_t batchCount() const
+    {
+        if (driver_ != nullptr) {
+            return (driver_->size() + SPARSE_BATCH_SIZE - 1) / SPARSE_BATCH_SIZE;
+        }
+        size_t count = 0;
+        for (const Archetype* archetype : archetypes_) {
+            count += archetype->getChunkCount();
+        }
+        return count;
+    }
+
+    /*
+     * Like each(), but batches are spread across the scene's job system and the call returns once every batch is done.
+     * func may also take the batch index first, func(size_t batch, Entity, Ts&...), to write into per-batch output buffers
+     * which can then be merged in batch order so the result doesn't depend on thread timing (see AppendBatches()).
+     * Runs on the calling thread when the scene has no job system.
+     */
+    template <typename Func>
+    void parallelEach(Func&& func)
+    {
+        JobSystem* job_system = scene_->job_system_;
+        if (job_system == nullptr) {
+            each(func);
+            return;
+        }
+        job_system->parallelFor(batchCount(), 0, [this, &func](size_t begin, size_t end) {
+            for (size_t batch = begin; batch < end; ++batch) {
+                EachInBatch(batch, func);
+            }
+        });
+    }
+
+    // Yields std::tuple<Entity, Ts&...>
+    class Iterator {
+       public:
+        using value_type = std::tuple<Entity, Ts&...>;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator(SceneView* view) : view_(view) { SkipUnmatched(); }
+
+        value_type operator*() const
+        {
+            const Entity entity = CurrentEntity();
+            if constexpr (HAS_MUTABLE_COMPONENTS) view_->MarkChanged(NO_TICK_COLUMNS, 0, entity);
+            return [&]<size_t... Is>(std::index_sequence<Is...>) {
+                if (view_->driver_ != nullptr) {
+                    return value_type{entity, *view_->template GetComponent<Is>(entity)...};
+                }
+                Archetype* archetype = view_->archetypes_[archetype_];
+                return value_type{entity, *(archetype->getChunkColumn(chunk_, view_->positions_[Is])
+                                                ? static_cast<Ts*>(archetype->getChunkColumn(chunk_, view_->positions_[Is])) + index_
+                                                : view_->template GetComponent<Is>(entity))...};
+            }(std::index_sequence_for<Ts...>{});
+        }
+
+        Iterator& operator++()
+        {
+            Advance();
+            SkipUnmatched();
+            return *this;
+        }
+
+        bool operator==(std::default_sentinel_t) const { return done_; }
+
+       private:
+        SceneView* view_;
+        bool done_ = false;
+        // position in the driving sparse set
+        size_t driver_index_ = 0;
+        // position in the archetypes
+        size_t archetype_ = 0;
+        size_t chunk_ = 0;
+        size_t index_ = 0; // within the chunk
+
+        Entity CurrentEntity() const
+        {
+            if (view_->driver_ != nullptr) return (*view_->driver_)[driver_index_];
+            return view_->archetypes_[archetype_]->getChunkEntities(chunk_)[index_];
+        }
+
+        void Advance()
+        {
+            if (view_->driver_ != nullptr) {
+                ++driver_index_;
+                return;
+            }
+            if (++index_ < view_->archetypes_[archetype_]->getChunkSize(chunk_)) return;
+            index_ = 0;
+            if (++chunk_ < view_->archetypes_[archetype_]->getChunkCount()) return;
+            chunk_ = 0;
+            ++archetype_;
+        }
+
+        // moves forward to the next entity that has all of the components, or to the end
+        void SkipUnmatched()
+        {
+            while (true) {
+                if (view_->driver_ != nullptr) {
+                    done_ = driver_index_ >= view_->driver_->size();
+                }
+                else {
+                    done_ = archetype_ >= view_->archetypes_.size();
+                }
+                if (done_) return;
+                const Entity entity = CurrentEntity();
+                const bool has_components = view_->has_sparse_components_ == false || view_->required_.isSubsetOf(view_->scene_->signatures_[entityIndex(entity)]);
+                if (has_components && (view_->tick_filter_count_ == 0 || view_->PassesTickFilters(NO_TICK_COLUMNS, 0, entity))) return;
+                Advance();
+            }
+        }
+    };
+
+    Iterator begin() { return Iterator(this); }
+    std::default_sentinel_t end() { return std::default_sentinel; }
+
+    // true if no entity matches. Stops at the first match.
+    bool empty() { return begin() == end(); }
+
+   private:
+    Scene* const scene_;
+    const std::array<size_t, sizeof...(Ts)> positions_;
+    Signature required_{};
+    bool has_sparse_components_ = false;
+    // archetypes containing all of the archetype-stored Ts, only walked when driver_ is nullptr
+    std::vector<Archetype*> archetypes_{};
+    // smallest sparse pool among Ts, nullptr to walk archetypes_ instead
+    const EntitySet* driver_ = nullptr;
+
+    struct TickFilter {
+        size_t index; // into Ts
+        bool added;
+        uint32_t since;
+    };
+    std::array<TickFilter, sizeof...(Ts) * 2> tick_filters_{};
+    size_t tick_filter_count_ = 0;
+
+    static constexpr bool HAS_MUTABLE_COMPONENTS = (... || (std::is_const_v<Ts> == false));
+
+    // the tick column of each of Ts in the current chunk, nullptr where the ticks must be looked up by entity
+    using TickColumns = std::array<ComponentTicks*, sizeof...(Ts)>;
+    static constexpr TickColumns NO_TICK_COLUMNS{};
+
+    template <typename T>
+    static constexpr size_t IndexOf()
+    {
+        constexpr std::array<bool, sizeof...(Ts)> matches{std::is_same_v<std::remove_const_t<Ts>, T>...};
+        for (size_t i = 0; i < matches.size(); ++i) {
+            if (matches[i]) return i;
+        }
+        return sizeof...(Ts);
+    }
+
+    // ticks of the index'th component of an entity, looked up without the chunk columns
+    ComponentTicks* GetTicks(size_t index, Entity entity)
+    {
+        const size_t position = positions_[index];
+        if (scene_->sparse_sets_[position]) {
+            return scene_->sparse_sets_[position]->getTicks(entity);
+        }
+        const Scene::EntityLocation& location = scene_->entity_locations_[entityIndex(entity)];
+        return scene_->archetypes_[location.archetype]->getTicks(location.row, position);
+    }
+
+    // 'i' is the entity's index within the chunk of 'tick_columns'
+    bool PassesTickFilters(const TickColumns& tick_columns, size_t i, Entity entity)
+    {
+        for (size_t f = 0; f < tick_filter_count_; ++f) {
+            const TickFilter& filter = tick_filters_[f];
+            const ComponentTicks& ticks = tick_columns[filter.index] ? tick_columns[filter.index][i] : *GetTicks(filter.index, entity);
+            if ((filter.added ? ticks.added : ticks.changed) <= filter.since) return false;
+        }
+        return true;
+    }
+
+    // stamps the non-const Ts of an entity with the scene's change tick
+    void MarkChanged(const TickColumns& tick_columns, size_t i, Entity entity)
+    {
+        [&]<size_t... Is>(std::index_sequence<Is...>) {
+            auto mark = [&]<size_t I>() {
+                if constexpr (std::is_const_v<std::tuple_element_t<I, std::tuple<Ts...>>> == false) {
+                    ComponentTicks& ticks = tick_columns[I] ? tick_columns[I][i] : *GetTicks(I, entity);
+                    ticks.changed = scene_->change_tick_;
+                }
+            };
+            (mark.template operator()<Is>(), ...);
+        }(std::index_sequence_for<Ts...>{});
+    }
+
+    // looks up the I'th component of an entity without going through the archetype chunk columns
+    template <size_t I>
+    std::tuple_element_t<I, std::tuple<Ts...>>* GetComponent(Entity entity)
+    {
+        using T = std::remove_const_t<std::tuple_element_t<I, std::tuple<Ts...>>>;
+        const size_t position = positions_[I];
+        if (scene_->sparse_sets_[position]) {
+            return static_cast<SparseSet<T>*>(scene_->sparse_sets_[position].get())->get(entity);
+        }
+        const Scene::EntityLocation& location = scene_->entity_locations_[entityIndex(entity)];
+        return static_cast<T*>(scene_->archetypes_[location.archetype]->getComponent(location.row, position));
+    }
+
+    template <typename Func>
+    void EachInBatch(size_t batch, Func& func)
+    {
+        if (driver_ != nullptr) {
+            const size_t begin = batch * SPARSE_BATCH_SIZE;
+            const size_t end = std::min(begin + SPARSE_BATCH_SIZE, driver_->size());
+            for (size_t i = begin; i < end; ++i) {
+                const Entity entity = driver_->data()[i];
+                if (required_.isSubsetOf(scene_->signatures_[entityIndex(entity)]) == false) continue;
+                if (tick_filter_count_ != 0 && PassesTickFilters(NO_TICK_COLUMNS, 0, entity) == false) continue;
+                if constexpr (HAS_MUTABLE_COMPONENTS) MarkChanged(NO_TICK_COLUMNS, 0, entity);
+                [&]<size_t... Is>(std::index_sequence<Is...>) { Invoke(func, batch, entity, *GetComponent<Is>(entity)...); }(std::index_sequence_for<Ts...>{});
+            }
+            return;
+        }
+
+        // find the archetype chunk this batch refers to
+        size_t chunk = batch;
+        auto archetype_it = archetypes_.begin();
+        while (chunk >= (*archetype_it)->getChunkCount()) {
+            chunk -= (*archetype_it)->getChunkCount();
+            ++archetype_it;
+        }
+        Archetype* archetype = *archetype_it;
+
+        const size_t count = archetype->getChunkSize(chunk);
+        const Entity* entities = archetype->getChunkEntities(chunk);
+        [&]<size_t... Is>(std::index_sequence<Is...>) {
+            // nullptr for sparse set components
+            const std::tuple<Ts*...> columns{static_cast<Ts*>(archetype->getChunkColumn(chunk, positions_[Is]))...};
+            const TickColumns tick_columns{archetype->getChunkTicks(chunk, positions_[Is])...};
+            for (size_t i = 0; i < count; ++i) {
+                if (has_sparse_components_ && required_.isSubsetOf(scene_->signatures_[entityIndex(entities[i])]) == false) continue;
+                if (tick_filter_count_ != 0 && PassesTickFilters(tick_columns, i, entities[i]) == false) continue;
+                if constexpr (HAS_MUTABLE_COMPONENTS) MarkChanged(tick_columns, i, entities[i]);
+                Invoke(func, batch, entities[i], (std::get<Is>(columns) ? std::get<Is>(columns)[i] : *GetComponent<Is>(entities[i]))...);
+            }
+        }(std::index_sequence_for<Ts...>{});
+    }
+
+    template <typename Func>
+    static void Invoke(Func& func, size_t batch, Entity entity, Ts&... components)
+    {
+        if constexpr (std::is_invocable_v<Func&, size_t, Entity, Ts&...>) {
+            func(batch, entity, components...);
+        }
+        else if constexpr (std::is_invocable_v<Func&, Entity, Ts&...>) {
+            func(entity, components...);
+        }
+        else {
+            func(components...);
+        }
+    }
+};
+
+// Moves the contents of per-batch buffers filled by SceneView::parallelEach() onto the end of 'out' in batch order, leaving the buffers empty for reuse
+template <typename T>
+void AppendBatches(std::vector<std::vector<T>>& batches, std::vector<T>& out)
+{
+    size_t total = out.size();
+    for (const std::vector<T>& batch : batches) {
+        total += batch.size();
+    }
+    out.reserve(total);
+    for (std::vector<T>& batch : batches) {
+        std::move(batch.begin(), batch.end(), std::back_inserter(out));
+        batch.clear();
+    }
+}
+
 } // namespace engine
\ No newline at end of file
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <future>
 #include <memory>
 #include <vector>
 
@@ -10,6 +14,20 @@ namespace engine {
 
 class Application;
 
+/*
+ * Returned by SceneManager::PreloadSceneAsync(). Pass it to SceneManager::TakePreloadedScene() once IsReady().
+ * The builder can't be cancelled: destroying a preload that isn't ready blocks until the builder has finished (in the std::future destructor).
+ * Keep it alive until it's taken, for example as a member of whatever starts the preload.
+ */
+class ScenePreload {
+   public:
+    bool IsReady() const { return future_.valid() && future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
+   private:
+    friend class SceneManager;
+    std::future<std::unique_ptr<Scene>> future_;
+};
+
 class SceneManager {
    public:
     SceneManager(Application* app);
@@ -20,6 +38,17 @@ class SceneManager {
     // creates an empty scene and sets it as active
     Scene* CreateEmptyScene();
 
+    /*
+     * Creates an empty scene and calls builder(*scene) on a new thread, so that loading a level doesn't stall the game loop.
+     * The builder runs while other scenes update and render. It must only change its own scene, resource managers and GFXDevice resources.
+     * The scene's systems don't use the job system until it is taken.
+     */
+    ScenePreload PreloadSceneAsync(std::function<void(Scene&)> builder);
+
+    // Adds a preloaded scene to the manager and returns it, ready to be set as active. Returns nullptr if it isn't ready yet.
+    // Rethrows anything thrown by the builder.
+    Scene* TakePreloadedScene(ScenePreload& preload);
+
     // nullptr deactivates the active scene
     void SetActiveScene(Scene* scene)
     {
@@ -44,7 +73,16 @@ class SceneManager {
         }
     }
 
-    // returns active scene, nullptr if no scene active
+    /*
+     * Live scenes are updated by UpdateActiveScene() even when they aren't active, on the job system alongside the active scene.
+     * Only the active scene is rendered. Each scene steps at its own rate, set with Scene::SetFixedTimestep().
+     * Systems in a live scene mustn't change anything shared with other scenes, such as the window, renderer or resource managers.
+     */
+    void SetSceneLive(Scene* scene, bool live);
+    bool IsSceneLive(Scene* scene) const { return std::find(live_scenes_.begin(), live_scenes_.end(), scene) != live_scenes_.end(); }
+
+    // Updates the active scene and every live scene, returning once they have all finished.
+    // Returns the active scene, nullptr if no scene active
     Scene* UpdateActiveScene(float ts);
     Scene* GetActiveScene() { return scenes_.at(active_scene_index_).get(); }
 
@@ -53,6 +91,7 @@ class SceneManager {
 
     std::vector<std::unique_ptr<Scene>> scenes_;
     int active_scene_index_ = -1;
+    std::vector<Scene*> live_scenes_{};
 };
 
 } // namespace engine
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+
+#include <memory>
+#include <unordered_map>
+
+#include <glm/ext/quaternion_float.hpp>
+#include <glm/mat4x3.hpp>
+#include <glm/vec3.hpp>
+
+namespace engine {
+
+class Mesh;     // forward-dec
+class Material; // forward-dec
+
+/*
+ * The meshes and materials a scene snapshot may refer to, keyed by Mesh::getContentHash() and Material::getContentHash().
+ * Snapshots don't contain resource data, so every resource used by a snapshot must be added before loading it.
+ */
+struct SnapshotResources {
+    std::unordered_map<uint64_t, std::shared_ptr<Mesh>> meshes{};
+    std::unordered_map<uint64_t, std::shared_ptr<Material>> materials{};
+
+    void add(const std::shared_ptr<Mesh>& mesh);
+    void add(const std::shared_ptr<Material>& material);
+};
+
+/*
+ * Snapshot file layout. Every section starts at a multiple of SNAPSHOT_ALIGNMENT from the start of the file,
+ * so a memory-mapped snapshot can be read in place.
+ *
+ * SnapshotHeader
+ * SnapshotEntity[entity_count], in hierarchy order so that parents come before their children
+ * char[strings_size], entity tags
+ * SnapshotMeshRenderable[mesh_renderable_count], ordered by entity
+ * SnapshotColumn[column_count], followed by the entity indices and component data each column points to
+ */
+constexpr uint32_t SNAPSHOT_MAGIC = 0x504E5345; // "ESNP"
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+constexpr uint64_t SNAPSHOT_ALIGNMENT = 16;
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t layout_hash; // sizes of the snapshot structs, which differ between builds using different glm settings
+    uint32_t entity_count;
+    uint32_t mesh_renderable_count;
+    uint32_t column_count;
+    uint32_t reserved;
+    uint64_t entities_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t mesh_renderables_offset;
+    uint64_t columns_offset;
+};
+
+struct SnapshotEntity {
+    glm::mat4x3 world_matrix;
+    glm::quat rotation;
+    glm::vec3 position;
+    glm::vec3 scale;
+    uint32_t parent; // index of the parent's SnapshotEntity plus 1, 0 for root entities
+    uint32_t tag_offset; // into the strings section
+    uint32_t tag_size;
+    uint32_t is_static;
+};
+
+struct SnapshotMeshRenderable {
+    uint32_t entity; // index of the SnapshotEntity
+    uint32_t visible;
+    uint64_t mesh_hash;
+    uint64_t material_hash;
+};
+
+// every component of one trivially copyable type, saved as raw bytes
+struct SnapshotColumn {
+    uint64_t type_hash; // ComponentTypeInfo::name_hash
+    uint64_t component_size;
+    uint64_t count;
+    uint64_t entities_offset; // uint32_t[count] indices of SnapshotEntities, ascending
+    uint64_t data_offset;     // count * component_size bytes
+};
+
+constexpr uint64_t snapshotLayoutHash()
+{
+    return (uint64_t{sizeof(SnapshotHeader)} << 48) ^ (uint64_t{sizeof(SnapshotEntity)} << 32) ^ (uint64_t{sizeof(SnapshotMeshRenderable)} << 16) ^
+           uint64_t{sizeof(SnapshotColumn)};
+}
+
+} // namespace engine
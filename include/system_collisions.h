@@ -30,6 +30,7 @@ class CollisionSystem : public System {
     CollisionSystem(Scene* scene);
 
     void onComponentInsert(Entity entity) override;
+    void onComponentRemove(Entity entity) override;
 
     void onUpdate(float ts) override;
 
@@ -55,11 +56,30 @@ class CollisionSystem : public System {
         PrimitiveInfo(const AABB& aabb, Entity entity_idx);
     };
 
+    // Nodes of the BVH, the root being bvh_[root_]. Nodes freed by removals have both slots Empty until they're reused.
     std::vector<BiTreeNode> bvh_{};
 
    private:
-    size_t colliders_size_last_update_ = 0;
-    size_t colliders_size_now_ = 0;
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+    // the tree is rebuilt from scratch once incremental changes make it this much more costly to traverse than when it was built
+    static constexpr float REBUILD_COST_RATIO = 1.5f;
+
+    // where an entity sits in the BVH, 'slot' being 0 for box1 and 1 for box2
+    struct LeafLocation {
+        uint32_t node = NO_NODE;
+        uint32_t slot = 0;
+    };
+
+    bool needs_rebuild_ = true;
+    uint32_t root_ = NO_NODE;
+    std::vector<uint32_t> node_parents_{}; // indexed like bvh_, NO_NODE for the root and free nodes
+    std::vector<uint32_t> free_nodes_{};
+    std::vector<LeafLocation> entity_leaves_{}; // indexed by entity index
+    size_t leaf_count_ = 0;
+    std::vector<Entity> pending_inserts_{}; // colliders added since the last update, inserted once their world matrix is known
+    double bounding_volume_area_ = 0.0; // summed surface area of every bounding volume slot, kept up to date by SetSlot()
+    float built_cost_ = 0.0f; // TreeCost() right after the last rebuild
+    std::vector<std::vector<PrimitiveInfo>> batch_prims_{}; // per-batch output of the primitive collection, kept to reuse allocations
 
     struct RaycastTreeNodeResult {
         glm::vec3 location;
@@ -71,6 +91,23 @@ class CollisionSystem : public System {
     RaycastTreeNodeResult RaycastTreeNode(const Ray& ray, const BiTreeNode& node);
 
     static int BuildNode(std::vector<PrimitiveInfo>& prims, std::vector<BiTreeNode>& tree_nodes);
+
+    void RebuildTree();
+    void InsertLeaf(Entity entity, const AABB& box);
+    void RemoveLeaf(Entity entity);
+    void RefitLeaf(Entity entity, const AABB& box);
+
+    // Empties a slot, then collapses nodes left with a single child so that the tree stays binary
+    void RemoveSlot(uint32_t node, uint32_t slot);
+    // Tightens the slot boxes pointing at 'node' and its ancestors, stopping once one doesn't change
+    void RefitUpwards(uint32_t node);
+    void SetSlot(uint32_t node, uint32_t slot, const AABB& box, uint32_t index, BiTreeNode::Type type);
+    void SetSlotBox(uint32_t node, uint32_t slot, const AABB& box);
+    uint32_t AllocateNode(uint32_t parent);
+    void FreeNode(uint32_t node);
+
+    // Surface area heuristic cost of traversing the tree, relative to the root's area. Grows as incremental changes loosen the tree.
+    float TreeCost() const;
 };
 
 } // namespace engine
\ No newline at end of file
@@ -20,6 +20,7 @@ public:
 
     void onUpdate(float ts) override;
     void onComponentInsert(Entity entity) override;
+    void onComponentRemove(Entity entity) override;
 };
 
 } // namespace engine
\ No newline at end of file
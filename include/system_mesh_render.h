@@ -1,5 +1,8 @@
 #pragma once
 
+#include <utility>
+#include <vector>
+
 #include <glm/mat4x4.hpp>
 
 #include "ecs.h"
@@ -15,6 +18,7 @@ struct RenderListEntry {
     const gfx::DescriptorSet* material_set;
     glm::mat4 model_matrix;
     uint32_t index_count;
+    Entity entity;
 };
 
 using RenderList = std::vector<RenderListEntry>;
@@ -27,18 +31,34 @@ class MeshRenderSystem : public System {
     void RebuildStaticRenderList();
     const RenderList* GetStaticRenderList() const { return &static_render_list_; }
     const RenderList* GetDynamicRenderList() const { return &dynamic_render_list_; }
+    // the dynamic render list with model matrices between the previous and the latest step, 'alpha' being Scene::GetInterpolationAlpha()
+    const RenderList* GetInterpolatedDynamicRenderList(float alpha);
 
     void onComponentInsert(Entity entity) override;
+    void onComponentRemove(Entity entity) override;
     void onUpdate(float ts) override;
 
    private:
+    // output of one SceneView batch while building a render list
+    struct RenderListBatch {
+        RenderList entries;
+        std::vector<std::pair<const gfx::Pipeline*, int>> render_orders;
+    };
+
     RenderList static_render_list_;
     RenderList dynamic_render_list_;
+    RenderList interpolated_dynamic_render_list_; // remade each frame when interpolating
     bool list_needs_rebuild_ = false;
+    bool dynamic_list_needs_rebuild_ = true;
+    // index into dynamic_render_list_ of each entity's entry, indexed by entity index. Entries of moved entities are updated in place.
+    std::vector<uint32_t> dynamic_entry_indices_;
+    std::vector<RenderListBatch> render_list_batches_; // kept between frames to reuse their allocations
 
     // with_static_entities = false, build list of dynamic meshes
     // with_static_entities = true, build list of static meshes
     void BuildRenderList(RenderList& render_list, bool with_static_entities);
+    // returns nullptr if the entity isn't in the dynamic render list
+    RenderListEntry* FindDynamicEntry(Entity entity);
 };
 
 } // namespace engine
\ No newline at end of file
@@ -1,6 +1,15 @@
 #pragma once
 
+#include <cstdint>
+
+#include <limits>
+#include <vector>
+
+#include <glm/mat4x3.hpp>
+#include <glm/mat4x4.hpp>
+
 #include "ecs.h"
+#include "transform_kernels.h"
 
 namespace engine {
 
@@ -10,12 +19,67 @@ class TransformSystem : public System {
     TransformSystem(Scene* scene);
 
     void onUpdate(float ts) override;
+    void onComponentInsert(Entity entity) override;
+    void onComponentRemove(Entity entity) override;
+
+    // nullptr if the entity's world matrix didn't change in the latest step, or the scene doesn't use a fixed timestep
+    const glm::mat4x3* GetPreviousWorldMatrix(Entity entity) const
+    {
+        const uint32_t index = entityIndex(entity);
+        if (index >= entity_slots_.size()) return nullptr;
+        const uint32_t slot = entity_slots_[index];
+        if (slot == NO_SLOT || slot_entities_[slot] != entity || slot_previous_steps_[slot] != step_count_) return nullptr;
+        return &slot_previous_world_matrices_[slot];
+    }
+
+    // world matrix between the previous and the latest step, 'alpha' being Scene::GetInterpolationAlpha()
+    glm::mat4 GetInterpolatedWorldMatrix(Entity entity, float alpha) const;
+
+    // Blends matrices component-wise. Rotations are only approximated, which is unnoticeable over a single step.
+    static glm::mat4x3 InterpolateMatrix(const glm::mat4x3& from, const glm::mat4x3& to, float alpha) { return from + (to - from) * alpha; }
+
+   private:
+    static constexpr uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t NO_SLOT = std::numeric_limits<uint32_t>::max();
+    static constexpr float MAX_TOMBSTONE_RATIO = 0.25f; // fraction of slots left by destroyed entities before the layout is rebuilt
+    static constexpr size_t COMPOSE_CHUNK_SIZE = 1024; // transforms per job when building local matrices
 
     /*
-     * Linear-searches for an entity that matches the arguments' criteria.
-     * Take care not to create multiple entities under a parent with the same tag, as this search will only find the first in the list.
+     * Every transform laid out breadth-first through the hierarchy when rebuilt, as parallel arrays indexed by slot.
+     * Parents always come before their children, so one linear pass resolves every world matrix.
+     * Static transforms are placed before 'first_dynamic_slot_', so the pass can start after them while none were written to.
+     * New entities are appended after their parents and destroyed ones leave a tombstone (entity 0), so spawning doesn't relayout.
+     * Rebuilt when Scene::GetReparentVersion() changes, a transform's is_static flag is toggled, a new static transform belongs in the static slots,
+     * or tombstones pass MAX_TOMBSTONE_RATIO.
      */
-    Entity GetChildEntity(Entity parent, const std::string& tag);
+    std::vector<Entity> slot_entities_{}; // 0 for tombstones
+    std::vector<uint32_t> slot_parents_{}; // slot of the parent, NO_PARENT for root entities
+    std::vector<glm::mat4x3> slot_local_matrices_{};
+    std::vector<glm::mat4x3> slot_world_matrices_{};
+    std::vector<uint8_t> slot_dirty_{}; // the world matrix needs rebuilding, cleared by the pass
+    // World matrix from before the latest step, only kept with a fixed timestep. Valid where slot_previous_steps_ equals step_count_,
+    // so the transforms that didn't change don't need clearing every step.
+    std::vector<glm::mat4x3> slot_previous_world_matrices_{};
+    std::vector<uint32_t> slot_previous_steps_{};
+    std::vector<uint32_t> entity_slots_{}; // indexed by entity index, NO_SLOT for entities not laid out yet
+    uint32_t first_dynamic_slot_ = 0;
+    size_t tombstone_count_ = 0;
+    std::vector<Entity> pending_entities_{}; // created since the last update, in the order systems were told about them
+
+    // scratch space for onUpdate(), kept to avoid reallocating every update
+    std::vector<uint32_t> changed_slots_{};
+    TransformArrays changed_trs_{}; // indexed like changed_slots_
+    std::vector<glm::mat4x3> changed_local_matrices_{}; // indexed like changed_slots_
+    std::vector<uint32_t> dirty_slots_{};
+    std::vector<uint32_t> child_slots_{}; // dirty slots that have a parent
+    uint64_t slots_reparent_version_ = std::numeric_limits<uint64_t>::max();
+    uint32_t step_count_ = 0; // incremented by every update
+
+    void RebuildSlots();
+    // lays out pending_entities_ at the end of the slots, returns false if one of them needs a rebuild to be placed
+    bool AppendPendingSlots();
+    // returns the entity's slot, first appending it (and any of its ancestors not laid out yet) if needed. NO_SLOT if it can't be appended.
+    uint32_t AppendSlot(Entity entity);
 };
 
-} // namespace engine
\ No newline at end of file
+} // namespace engine
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/mat4x3.hpp>
+#include <glm/vec3.hpp>
+
+namespace engine {
+
+/*
+ * Position, rotation and scale of a set of transforms, one array per component,
+ * so that the kernels below can load several transforms into a SIMD register at once.
+ */
+struct TransformArrays {
+    std::vector<float> position[3];
+    std::vector<float> rotation[4]; // x, y, z, w
+    std::vector<float> scale[3];
+
+    size_t size() const { return position[0].size(); }
+
+    void clear()
+    {
+        for (auto& array : position) array.clear();
+        for (auto& array : rotation) array.clear();
+        for (auto& array : scale) array.clear();
+    }
+
+    void push(const glm::vec3& pos, const glm::quat& rot, const glm::vec3& scl)
+    {
+        for (int i = 0; i < 3; ++i) position[i].push_back(pos[i]);
+        rotation[0].push_back(rot.x);
+        rotation[1].push_back(rot.y);
+        rotation[2].push_back(rot.z);
+        rotation[3].push_back(rot.w);
+        for (int i = 0; i < 3; ++i) scale[i].push_back(scl[i]);
+    }
+};
+
+enum class TransformKernelLevel {
+    SCALAR,
+    SSE2, // 4 transforms at a time
+    AVX2, // 8 transforms at a time
+};
+
+// Picked once from what the CPU supports. The SIMD levels are only available on x86-64.
+TransformKernelLevel GetTransformKernelLevel();
+
+const char* GetTransformKernelName(TransformKernelLevel level);
+
+/*
+ * Builds the local matrix of transforms [begin, end) of 'trs' into out[0, end - begin).
+ * Matches glm::mat4_cast() of the rotation, with the position in the last column and the scale applied first, without the bottom row.
+ */
+void ComposeTransforms(const TransformArrays& trs, size_t begin, size_t end, glm::mat4x3* out);
+void ComposeTransforms(const TransformArrays& trs, size_t begin, size_t end, glm::mat4x3* out, TransformKernelLevel level);
+
+/*
+ * For each slot s in slots[0, count), sets world[s] = world[parents[s]] * local[s].
+ * The matrices are affine, with the implied bottom row 0, 0, 0, 1.
+ * Slots are handled in order, so a parent listed earlier in 'slots' is resolved before its children.
+ */
+void MultiplyAffineTransforms(glm::mat4x3* world, const glm::mat4x3* local, const uint32_t* parents, const uint32_t* slots, size_t count);
+void MultiplyAffineTransforms(glm::mat4x3* world, const glm::mat4x3* local, const uint32_t* parents, const uint32_t* slots, size_t count,
+                              TransformKernelLevel level);
+
+} // namespace engine
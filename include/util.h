@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 
 namespace engine {
 
@@ -17,4 +20,27 @@ inline bool VersionFromCharArray(const char* version, int* major, int* minor, in
     }
 }
 
+// Mixes 'value' into 'seed'. Used to build content hashes out of several parts.
+inline uint64_t HashCombine(uint64_t seed, uint64_t value) { return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)); }
+
+// Content hash of a block of memory, read 8 bytes at a time. Not cryptographic.
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0)
+{
+    constexpr uint64_t kMultiplier = 0x9e3779b97f4a7c15ull;
+    const auto bytes = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ (size * kMultiplier);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        word *= kMultiplier;
+        word ^= word >> 32;
+        h = (h ^ word) * kMultiplier;
+    }
+    for (; i < size; ++i) {
+        h = (h ^ bytes[i]) * kMultiplier;
+    }
+    return h ^ (h >> 29);
+}
+
 } // namespace engine
\ No newline at end of file
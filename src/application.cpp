@@ -33,6 +33,7 @@
 #include "scene_manager.h"
 #include "system_collisions.h"
 #include "system_mesh_render.h"
+#include "system_transform.h"
 #include "window.h"
 
 static struct ImGuiThings {
@@ -243,6 +244,7 @@ void drawBoundingVolumes(Scene* scene, std::vector<DebugLine>& debug_lines)
 Application::Application(const char* appName, const char* appVersion, gfx::GraphicsSettings graphicsSettings, AppConfiguration configuration)
     : m_configuration(configuration), app_name(appName), app_version(appVersion)
 {
+    m_job_system = std::make_unique<JobSystem>(configuration.job_system_info);
     m_window = std::make_unique<Window>(appName, true, true);
     m_input_manager = std::make_unique<InputManager>(*m_window);
     m_scene_manager = std::make_unique<SceneManager>(this);
@@ -387,7 +389,7 @@ void Application::gameLoop()
     auto beginFrame = std::chrono::steady_clock::now();
     auto endFrame = beginFrame + frametimeFromFPS(fps_limit);
 
-    // single-threaded game loop
+    // game loop. Scenes spread their work across the job system, but the loop itself runs on this thread
     while (m_window->IsRunning()) {
         /* logic */
 
@@ -487,23 +489,14 @@ void Application::gameLoop()
                     ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoFocusOnAppearing)) {
                 ImGui::Text("Scene hierarchy:");
 
-                std::function<int(Entity, int)> find_depth = [&](Entity e, int current_depth) -> int {
-                    Entity parent = scene->GetComponent<TransformComponent>(e)->parent;
-                    if (parent == 0)
-                        return current_depth;
-                    else {
-                        return find_depth(parent, current_depth + 1);
-                    }
-                };
                 if (scene) {
-                    for (Entity i = 1; i < scene->next_entity_id_; ++i) {
-                        auto t = scene->GetComponent<TransformComponent>(i);
+                    scene->ForEachDescendant(0, [scene](Entity entity) {
                         std::string tabs{};
-                        int depth = find_depth(i, 0);
-                        for (int j = 0; j < depth; ++j) tabs += std::string{"    "};
-                        ImGui::Text("%s%s", tabs.c_str(), t->tag.c_str());
+                        const uint32_t depth = scene->GetEntityDepth(entity);
+                        for (uint32_t j = 0; j < depth; ++j) tabs += std::string{"    "};
+                        ImGui::Text("%s%s", tabs.c_str(), scene->GetEntityTag(entity).c_str());
                         // ImGui::Text("%.1f %.1f %.1f", t->position.x, t->position.y, t->position.z);
-                    }
+                    });
                 }
                 else {
                     ImGui::Text("No scene active!");
@@ -524,12 +517,14 @@ void Application::gameLoop()
             if (debug_menu_state.show_bounding_volumes) {
                 drawBoundingVolumes(scene, debug_lines);
             }
+            // draw the scene between its last two steps, so that it moves smoothly when rendering faster than it is simulated
+            const float alpha = scene->GetInterpolationAlpha();
             if (const Entity camera = scene->GetEntity("camera")) {
-                camera_transform = scene->GetComponent<TransformComponent>(camera)->world_matrix;
+                camera_transform = scene->GetSystem<TransformSystem>()->GetInterpolatedWorldMatrix(camera, alpha);
             }
-            const MeshRenderSystem* const mesh_render_system = scene->GetSystem<MeshRenderSystem>();
+            MeshRenderSystem* const mesh_render_system = scene->GetSystem<MeshRenderSystem>();
             static_list = mesh_render_system->GetStaticRenderList();
-            dynamic_list = mesh_render_system->GetDynamicRenderList();
+            dynamic_list = mesh_render_system->GetInterpolatedDynamicRenderList(alpha);
         }
         m_renderer->Render(getWindow()->GetWindowResized(), camera_transform, static_list, dynamic_list, debug_lines);
         debug_lines.clear(); // gets remade every frame :0
@@ -1,16 +1,55 @@
 #include "ecs.h"
 
+#include <atomic>
+#include <stdexcept>
+
 #include "scene.h"
 
 namespace engine {
 
-	System::System(Scene* scene, std::set<size_t> requiredComponentHashes)
+	size_t nextComponentTypeId()
+	{
+		static std::atomic<size_t> s_next_id = 0;
+		const size_t id = s_next_id++;
+		if (id >= MAX_COMPONENTS) {
+			throw std::runtime_error("Too many component types! Increase ENGINE_MAX_COMPONENTS.");
+		}
+		return id;
+	}
+
+	size_t nextSystemTypeId()
+	{
+		static std::atomic<size_t> s_next_id = 0;
+		return s_next_id++;
+	}
+
+	System::System(Scene* scene, std::set<size_t> requiredComponentIds)
 		: m_scene(scene)
 	{
-		for (size_t componentHash : requiredComponentHashes) {
-			size_t componentSignaturePosition = m_scene->GetComponentSignaturePosition(componentHash);
-			m_signature.set(componentSignaturePosition);
+		for (size_t componentId : requiredComponentIds) {
+			m_signature.set(componentId);
+		}
+	}
+
+	bool System::conflicts(const System& a, const System& b)
+	{
+		if (a.m_exclusive || b.m_exclusive) return true;
+		// write-write, write-read, and read-write on the same component all conflict
+		if ((a.m_writes & (b.m_reads | b.m_writes)).none() == false) return true;
+		return (b.m_writes & a.m_reads).none() == false;
+	}
+
+	void System::declareAccess(std::set<size_t> readComponentIds, std::set<size_t> writeComponentIds)
+	{
+		m_reads = Signature{};
+		m_writes = Signature{};
+		for (size_t componentId : readComponentIds) {
+			m_reads.set(componentId);
+		}
+		for (size_t componentId : writeComponentIds) {
+			m_writes.set(componentId);
 		}
+		m_exclusive = false;
 	}
 
 }
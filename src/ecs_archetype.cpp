@@ -0,0 +1,145 @@
+#include "ecs_archetype.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace engine {
+
+static constexpr std::align_val_t CHUNK_ALIGNMENT{64};
+
+static size_t alignUp(size_t offset, size_t alignment) { return (offset + alignment - 1) / alignment * alignment; }
+
+Archetype::Archetype(const Signature& signature, const std::vector<ComponentTypeInfo>& component_infos) : m_signature(signature)
+{
+    m_columns.fill(-1);
+    signature.forEachSetBit([&](size_t position) {
+        assert(position < component_infos.size());
+        m_columns[position] = static_cast<int>(m_column_positions.size());
+        m_column_positions.push_back(position);
+        m_column_infos.push_back(component_infos[position]);
+    });
+
+    // lays out a chunk holding 'capacity' entities and returns the number of bytes needed
+    auto layout_chunk = [this](size_t capacity) -> size_t {
+        size_t offset = sizeof(Entity) * capacity;
+        m_column_offsets.clear();
+        for (const ComponentTypeInfo& info : m_column_infos) {
+            offset = alignUp(offset, info.alignment);
+            m_column_offsets.push_back(offset);
+            offset += info.size * capacity;
+        }
+        m_tick_offsets.clear();
+        for (size_t column = 0; column < m_column_infos.size(); ++column) {
+            offset = alignUp(offset, alignof(ComponentTicks));
+            m_tick_offsets.push_back(offset);
+            offset += sizeof(ComponentTicks) * capacity;
+        }
+        return offset;
+    };
+
+    size_t row_bytes = sizeof(Entity);
+    for (const ComponentTypeInfo& info : m_column_infos) {
+        row_bytes += info.size + sizeof(ComponentTicks);
+    }
+    m_chunk_capacity = ARCHETYPE_CHUNK_SIZE / row_bytes;
+    // alignment padding between columns may push the layout over the chunk size
+    while (m_chunk_capacity > 1 && layout_chunk(m_chunk_capacity) > ARCHETYPE_CHUNK_SIZE) {
+        --m_chunk_capacity;
+    }
+    if (m_chunk_capacity == 0) m_chunk_capacity = 1; // very large components get a chunk each
+    m_chunk_bytes = std::max(layout_chunk(m_chunk_capacity), ARCHETYPE_CHUNK_SIZE);
+}
+
+Archetype::~Archetype()
+{
+    for (size_t row = 0; row < m_size; ++row) {
+        for (size_t column = 0; column < m_column_infos.size(); ++column) {
+            m_column_infos[column].destroy(getComponent(row, m_column_positions[column]));
+        }
+    }
+    for (std::byte* chunk : m_chunks) {
+        ::operator delete(chunk, CHUNK_ALIGNMENT);
+    }
+}
+
+size_t Archetype::allocateRow(Entity entity)
+{
+    const size_t row = m_size;
+    if (row / m_chunk_capacity == m_chunks.size()) {
+        m_chunks.push_back(static_cast<std::byte*>(::operator new(m_chunk_bytes, CHUNK_ALIGNMENT)));
+    }
+    ++m_size;
+    getChunkEntities(row / m_chunk_capacity)[row % m_chunk_capacity] = entity;
+    return row;
+}
+
+size_t Archetype::allocateRows(const Entity* entities, size_t count)
+{
+    const size_t first_row = m_size;
+    const size_t chunks_needed = (m_size + count + m_chunk_capacity - 1) / m_chunk_capacity;
+    m_chunks.reserve(chunks_needed);
+    while (m_chunks.size() < chunks_needed) {
+        m_chunks.push_back(static_cast<std::byte*>(::operator new(m_chunk_bytes, CHUNK_ALIGNMENT)));
+    }
+    // entity ids are copied a chunk at a time
+    for (size_t i = 0; i < count;) {
+        const size_t row = first_row + i;
+        const size_t n = std::min(m_chunk_capacity - row % m_chunk_capacity, count - i);
+        std::copy_n(entities + i, n, getChunkEntities(row / m_chunk_capacity) + row % m_chunk_capacity);
+        i += n;
+    }
+    m_size += count;
+    return first_row;
+}
+
+Entity Archetype::removeRow(size_t row)
+{
+    assert(row < m_size);
+    for (size_t column = 0; column < m_column_infos.size(); ++column) {
+        m_column_infos[column].destroy(getComponent(row, m_column_positions[column]));
+    }
+    return fillGap(row);
+}
+
+std::pair<size_t, Entity> Archetype::moveRow(size_t row, Archetype& dst)
+{
+    assert(row < m_size);
+    assert(&dst != this);
+    const size_t dst_row = dst.allocateRow(getEntity(row));
+    for (size_t column = 0; column < m_column_infos.size(); ++column) {
+        void* src_component = getComponent(row, m_column_positions[column]);
+        void* dst_component = dst.getComponent(dst_row, m_column_positions[column]);
+        if (dst_component) {
+            m_column_infos[column].relocate(dst_component, src_component);
+            *dst.getTicks(dst_row, m_column_positions[column]) = *getTicks(row, m_column_positions[column]);
+        }
+        else {
+            m_column_infos[column].destroy(src_component);
+        }
+    }
+    return std::make_pair(dst_row, fillGap(row));
+}
+
+// moves the last row into 'row', whose components must already have been destroyed or relocated
+Entity Archetype::fillGap(size_t row)
+{
+    const size_t last_row = m_size - 1;
+    Entity moved_entity = 0;
+    if (row != last_row) {
+        moved_entity = getEntity(last_row);
+        getChunkEntities(row / m_chunk_capacity)[row % m_chunk_capacity] = moved_entity;
+        for (size_t column = 0; column < m_column_infos.size(); ++column) {
+            m_column_infos[column].relocate(getComponent(row, m_column_positions[column]), getComponent(last_row, m_column_positions[column]));
+            *getTicks(row, m_column_positions[column]) = *getTicks(last_row, m_column_positions[column]);
+        }
+    }
+    --m_size;
+    // free the last chunk once it is empty
+    if (m_size % m_chunk_capacity == 0 && m_size / m_chunk_capacity < m_chunks.size()) {
+        ::operator delete(m_chunks.back(), CHUNK_ALIGNMENT);
+        m_chunks.pop_back();
+    }
+    return moved_entity;
+}
+
+} // namespace engine
@@ -0,0 +1,63 @@
+#include "ecs_command_buffer.h"
+
+#include <cassert>
+
+namespace engine {
+
+static size_t alignUp(size_t offset, size_t alignment) { return (offset + alignment - 1) / alignment * alignment; }
+
+EntityCommandBuffer::~EntityCommandBuffer() { clear(); }
+
+EntityCommandBuffer::PendingEntity EntityCommandBuffer::createEntity(const std::string& tag, EntityRef parent, const glm::vec3& pos, const glm::quat& rot,
+                                                                     const glm::vec3& scl)
+{
+    assert(parent.pending == EntityRef::NOT_PENDING || parent.pending < m_creates.size());
+    m_creates.push_back(CreateCommand{tag, parent, pos, rot, scl});
+    return PendingEntity{static_cast<uint32_t>(m_creates.size() - 1)};
+}
+
+void EntityCommandBuffer::clear()
+{
+    destroyComponents(m_commands);
+    m_creates.clear();
+    m_commands.clear();
+    m_current_block = 0;
+    m_block_offset = 0;
+    m_large_allocations.clear();
+}
+
+void* EntityCommandBuffer::allocate(size_t size, size_t alignment)
+{
+    // new[] only guarantees the default alignment, so over-allocate and align the pointer itself
+    if (size + alignment > BLOCK_SIZE) {
+        m_large_allocations.emplace_back(std::make_unique<std::byte[]>(size + alignment));
+        std::byte* base = m_large_allocations.back().get();
+        return base + (alignUp(reinterpret_cast<uintptr_t>(base), alignment) - reinterpret_cast<uintptr_t>(base));
+    }
+
+    while (true) {
+        if (m_current_block == m_blocks.size()) {
+            m_blocks.emplace_back(std::make_unique<std::byte[]>(BLOCK_SIZE));
+        }
+        const uintptr_t base = reinterpret_cast<uintptr_t>(m_blocks[m_current_block].get());
+        const size_t offset = alignUp(base + m_block_offset, alignment) - base;
+        if (offset + size <= BLOCK_SIZE) {
+            m_block_offset = offset + size;
+            return m_blocks[m_current_block].get() + offset;
+        }
+        ++m_current_block;
+        m_block_offset = 0;
+    }
+}
+
+void EntityCommandBuffer::destroyComponents(std::vector<Command>& commands)
+{
+    for (Command& command : commands) {
+        if (command.data != nullptr) {
+            command.info->destroy(command.data);
+            command.data = nullptr;
+        }
+    }
+}
+
+} // namespace engine
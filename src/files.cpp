@@ -1,7 +1,17 @@
 #include "files.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <fstream>
 #include <cstring>
+#include <stdexcept>
 
 #include "stb_image.h"
 
@@ -77,4 +87,71 @@ std::unique_ptr<std::vector<uint8_t>> readImageFile(const std::string& path, int
     return buffer;
 }
 
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Unable to open file " + path);
+    }
+    LARGE_INTEGER file_size{};
+    GetFileSizeEx(file, &file_size);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+    file_handle_ = file;
+    if (size_ == 0) return; // empty files can't be mapped
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        throw std::runtime_error("Unable to map file " + path);
+    }
+    mapping_handle_ = mapping;
+    data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Unable to map file " + path);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_handle_) CloseHandle(mapping_handle_);
+    CloseHandle(file_handle_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Unable to open file " + path);
+    }
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("Unable to open file " + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ != 0) { // empty files can't be mapped
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Unable to map file " + path);
+        }
+        data_ = static_cast<const uint8_t*>(mapping);
+    }
+    close(fd); // the mapping keeps the file open
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+#endif
+
 } // namespace engine
@@ -29,6 +29,7 @@
 #include <optional>
 #include <deque>
 #include <map>
+#include <mutex>
 #include <iostream>
 
 #include <SDL_vulkan.h>
@@ -313,19 +314,58 @@ static VkShaderModule compileShader(VkDevice device, shaderc_shader_kind kind, c
     return shaderModule;
 }
 
-static void copyBuffer(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+// Uploads record into a command pool of their own, so that threads uploading resources don't contend with rendering for a shared pool.
+// Destroying the pool frees the command buffer.
+static VkCommandBuffer allocateOneOffCommandBuffer(VkDevice device, uint32_t queueFamily, VkCommandPool* pool)
 {
-    [[maybe_unused]] VkResult res;
+    VkCommandPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                                     .pNext = nullptr,
+                                     .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                                     .queueFamilyIndex = queueFamily};
+    VKCHECK(vkCreateCommandPool(device, &poolInfo, nullptr, pool));
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
+    allocInfo.commandPool = *pool;
     allocInfo.commandBufferCount = 1;
 
     VkCommandBuffer commandBuffer;
-    res = vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-    VKCHECK(res);
+    VKCHECK(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer));
+    return commandBuffer;
+}
+
+// Submits a recorded one-off command buffer and waits for it on a fence.
+// queueMutex is only held for the submit, so a long upload doesn't block rendering on other threads.
+static void submitOneOffCommandBuffer(VkDevice device, VkQueue queue, std::mutex& queueMutex, VkCommandPool pool, VkCommandBuffer commandBuffer)
+{
+    VkFenceCreateInfo fenceInfo{.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, .pNext = nullptr, .flags = 0};
+    VkFence fence;
+    VKCHECK(vkCreateFence(device, &fenceInfo, nullptr, &fence));
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    {
+        std::lock_guard lock(queueMutex);
+        VKCHECK(vkQueueSubmit(queue, 1, &submitInfo, fence));
+    }
+
+    VKCHECK(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+
+    vkDestroyFence(device, fence, nullptr);
+    vkDestroyCommandPool(device, pool, nullptr);
+}
+
+static void copyBuffer(VkDevice device, uint32_t queueFamily, VkQueue queue, std::mutex& queueMutex, VkBuffer srcBuffer, VkBuffer dstBuffer,
+                       VkDeviceSize size)
+{
+    [[maybe_unused]] VkResult res;
+
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer = allocateOneOffCommandBuffer(device, queueFamily, &commandPool);
 
     { // record the command buffer
         VkCommandBufferBeginInfo beginInfo{};
@@ -344,19 +384,7 @@ static void copyBuffer(VkDevice device, VkCommandPool commandPool, VkQueue queue
         VKCHECK(res);
     }
 
-    // submit
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    res = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-    VKCHECK(res);
-
-    res = vkQueueWaitIdle(queue);
-    VKCHECK(res);
-
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    submitOneOffCommandBuffer(device, queue, queueMutex, commandPool, commandBuffer);
 }
 
 // class definitions
@@ -381,12 +409,14 @@ struct GFXDevice::Impl {
 
     std::array<WriteQueues, FRAMES_IN_FLIGHT> write_queues{};
 
-    // For one-off transfer operations not bound to a specific frame-in-flight
-    VkCommandPool transferCommandPool = VK_NULL_HANDLE;
     // For one-off operation on the draw queue family not bound to a specific
     // frame-in-flight
     VkCommandPool graphicsCommandPool = VK_NULL_HANDLE;
 
+    // Resources may be created on other threads while rendering.
+    // Guards the queues, graphicsCommandPool and the descriptor pool. Uploads use command pools of their own.
+    std::mutex queueMutex{};
+
     uint64_t FRAMECOUNT = 0;
 
     FrameData frameData[FRAMES_IN_FLIGHT] = {};
@@ -509,13 +539,6 @@ GFXDevice::GFXDevice(const char* appName, const char* appVersion, SDL_Window* wi
         VKCHECK(vkAllocateCommandBuffers(pimpl->device.device, &cmdAllocInfo, &pimpl->frameData[i].transferBuf));
     }
 
-    /* create command pool for one-off transfer operations */
-    VkCommandPoolCreateInfo transferPoolInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-                                             .pNext = nullptr,
-                                             .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, // These command buffers
-                                                                                            // don't last very long
-                                             .queueFamilyIndex = pimpl->device.queues.transferQueueFamily};
-    VKCHECK(vkCreateCommandPool(pimpl->device.device, &transferPoolInfo, nullptr, &pimpl->transferCommandPool));
     /* create command pool for one-off draw queue operations */
     VkCommandPoolCreateInfo graphicsPoolInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
                                              .pNext = nullptr,
@@ -544,7 +567,6 @@ GFXDevice::~GFXDevice()
     vkDestroyDescriptorPool(pimpl->device.device, pimpl->descriptorPool, nullptr);
 
     vkDestroyCommandPool(pimpl->device.device, pimpl->graphicsCommandPool, nullptr);
-    vkDestroyCommandPool(pimpl->device.device, pimpl->transferCommandPool, nullptr);
 
     for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
         vkDestroyCommandPool(pimpl->device.device, pimpl->frameData[i].transferPool, nullptr);
@@ -718,7 +740,10 @@ gfx::DrawBuffer* GFXDevice::beginRender(bool window_resized)
         .signalSemaphoreCount = 1,
         .pSignalSemaphores = &frameData.transferSemaphore,
     };
-    res = vkQueueSubmit(pimpl->device.queues.transferQueues[0], 1, &transferSubmitInfo, VK_NULL_HANDLE);
+    {
+        std::lock_guard lock(pimpl->queueMutex);
+        res = vkQueueSubmit(pimpl->device.queues.transferQueues[0], 1, &transferSubmitInfo, VK_NULL_HANDLE);
+    }
     VKCHECK(res);
 
     uint32_t swapchainImageIndex;
@@ -732,6 +757,7 @@ gfx::DrawBuffer* GFXDevice::beginRender(bool window_resized)
     do {
         if (pimpl->swapchainIsOutOfDate) {
             // re-create swapchain
+            std::lock_guard lock(pimpl->queueMutex);
             vkQueueWaitIdle(pimpl->device.queues.drawQueues[0]);
             vkQueueWaitIdle(pimpl->device.queues.presentQueue);
             createSwapchain(&pimpl->swapchain, pimpl->swapchainInfo);
@@ -983,6 +1009,8 @@ void GFXDevice::finishRender(gfx::DrawBuffer* drawBuffer)
         .signalSemaphoreCount = 1,
         .pSignalSemaphores = &drawBuffer->frameData.renderSemaphore,
     };
+    std::unique_lock lock(pimpl->queueMutex);
+
     res = vkQueueSubmit(pimpl->device.queues.drawQueues[0], 1, &submitInfo, drawBuffer->frameData.renderFence);
     VKCHECK(res);
 
@@ -997,6 +1025,7 @@ void GFXDevice::finishRender(gfx::DrawBuffer* drawBuffer)
                                  .pImageIndices = &swapchainImageIndex,
                                  .pResults = nullptr};
     res = vkQueuePresentKHR(pimpl->device.queues.presentQueue, &presentInfo);
+    lock.unlock();
     if (res == VK_ERROR_OUT_OF_DATE_KHR) {
         // flag to re-create the swapchain next frame
         pimpl->swapchainIsOutOfDate = true;
@@ -1062,7 +1091,10 @@ gfx::DrawBuffer* GFXDevice::beginShadowmapRender(gfx::Image* image)
     VkResult res;
 
     /* record command buffer */
-    res = vkResetCommandPool(pimpl->device.device, pimpl->graphicsCommandPool, 0);
+    {
+        std::lock_guard lock(pimpl->queueMutex);
+        res = vkResetCommandPool(pimpl->device.device, pimpl->graphicsCommandPool, 0);
+    }
     VKCHECK(res);
 
     VkCommandBufferBeginInfo beginInfo{
@@ -1203,6 +1235,8 @@ void GFXDevice::finishShadowmapRender(gfx::DrawBuffer* draw_buffer, gfx::Image*
         .signalSemaphoreCount = 0,
         .pSignalSemaphores = nullptr,
     };
+    std::lock_guard lock(pimpl->queueMutex);
+
     res = vkQueueSubmit(pimpl->device.queues.drawQueues[0], 1, &submitInfo, VK_NULL_HANDLE);
     VKCHECK(res);
 
@@ -1544,6 +1578,7 @@ gfx::DescriptorSet* GFXDevice::allocateDescriptorSet(const gfx::DescriptorSetLay
 
     gfx::DescriptorSet* set = new gfx::DescriptorSet{};
 
+    std::lock_guard lock(pimpl->queueMutex);
     for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
         VkDescriptorSetAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
                                               .pNext = nullptr,
@@ -1563,6 +1598,7 @@ gfx::DescriptorSet* GFXDevice::allocateDescriptorSet(const gfx::DescriptorSetLay
 void GFXDevice::freeDescriptorSet(const gfx::DescriptorSet* set)
 {
     assert(set != nullptr);
+    std::lock_guard lock(pimpl->queueMutex);
     VKCHECK(vkFreeDescriptorSets(pimpl->device.device, pimpl->descriptorPool, static_cast<uint32_t>(set->sets.size()), set->sets.data()));
 }
 
@@ -1670,8 +1706,8 @@ gfx::UniformBuffer* GFXDevice::createUniformBuffer(uint64_t size, const void* in
         VKCHECK(vmaCreateBuffer(pimpl->allocator, &gpuBufferInfo, &gpuAllocationInfo, &out->gpuBuffers[i].buffer, &out->gpuBuffers[i].allocation, nullptr));
 
         /* copy staging buffer into both */
-        copyBuffer(pimpl->device.device, pimpl->transferCommandPool, pimpl->device.queues.transferQueues[0], out->stagingBuffer.buffer,
-                   out->gpuBuffers[i].buffer, out->stagingBuffer.size);
+        copyBuffer(pimpl->device.device, pimpl->device.queues.transferQueueFamily, pimpl->device.queues.transferQueues[0], pimpl->queueMutex,
+                   out->stagingBuffer.buffer, out->gpuBuffers[i].buffer, out->stagingBuffer.size);
     }
 
     return out;
@@ -1762,7 +1798,8 @@ gfx::Buffer* GFXDevice::createBuffer(gfx::BufferType type, uint64_t size, const
     }
 
     // copy the data from the staging buffer to the gpu buffer
-    copyBuffer(pimpl->device.device, pimpl->transferCommandPool, pimpl->device.queues.transferQueues[0], stagingBuffer, out->buffer, out->size);
+    copyBuffer(pimpl->device.device, pimpl->device.queues.transferQueueFamily, pimpl->device.queues.transferQueues[0], pimpl->queueMutex, stagingBuffer,
+               out->buffer, out->size);
 
     // destroy staging buffer
     vmaDestroyBuffer(pimpl->allocator, stagingBuffer, stagingAllocation);
@@ -1852,14 +1889,8 @@ gfx::Image* GFXDevice::createImage(uint32_t w, uint32_t h, gfx::ImageFormat inpu
     VKCHECK(vkCreateImageView(pimpl->device.device, &viewInfo, nullptr, &out->view));
 
     /* begin command buffer */
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = pimpl->graphicsCommandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    VKCHECK(vkAllocateCommandBuffers(pimpl->device.device, &allocInfo, &commandBuffer));
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer = allocateOneOffCommandBuffer(pimpl->device.device, pimpl->device.queues.presentAndDrawQueueFamily, &commandPool);
 
     { // record the command buffer
         VkCommandBufferBeginInfo beginInfo{};
@@ -2016,16 +2047,7 @@ gfx::Image* GFXDevice::createImage(uint32_t w, uint32_t h, gfx::ImageFormat inpu
     }
 
     // submit
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    VKCHECK(vkQueueSubmit(pimpl->device.queues.drawQueues[0], 1, &submitInfo, VK_NULL_HANDLE));
-
-    VKCHECK(vkQueueWaitIdle(pimpl->device.queues.drawQueues[0]));
-
-    vkFreeCommandBuffers(pimpl->device.device, pimpl->graphicsCommandPool, 1, &commandBuffer);
+    submitOneOffCommandBuffer(pimpl->device.device, pimpl->device.queues.drawQueues[0], pimpl->queueMutex, commandPool, commandBuffer);
 
     vmaDestroyBuffer(pimpl->allocator, stagingBuffer, stagingAllocation);
 
@@ -2114,14 +2136,8 @@ gfx::Image* GFXDevice::createImageCubemap(uint32_t w, uint32_t h, gfx::ImageForm
     VKCHECK(vkCreateImageView(pimpl->device.device, &viewInfo, nullptr, &out->view));
 
     /* begin command buffer */
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = pimpl->graphicsCommandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    VKCHECK(vkAllocateCommandBuffers(pimpl->device.device, &allocInfo, &commandBuffer));
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer = allocateOneOffCommandBuffer(pimpl->device.device, pimpl->device.queues.presentAndDrawQueueFamily, &commandPool);
 
     { // record the command buffer
         VkCommandBufferBeginInfo beginInfo{};
@@ -2275,16 +2291,7 @@ gfx::Image* GFXDevice::createImageCubemap(uint32_t w, uint32_t h, gfx::ImageForm
     }
 
     // submit
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    VKCHECK(vkQueueSubmit(pimpl->device.queues.drawQueues[0], 1, &submitInfo, VK_NULL_HANDLE));
-
-    VKCHECK(vkQueueWaitIdle(pimpl->device.queues.drawQueues[0]));
-
-    vkFreeCommandBuffers(pimpl->device.device, pimpl->graphicsCommandPool, 1, &commandBuffer);
+    submitOneOffCommandBuffer(pimpl->device.device, pimpl->device.queues.drawQueues[0], pimpl->queueMutex, commandPool, commandBuffer);
 
     vmaDestroyBuffer(pimpl->allocator, stagingBuffer, stagingAllocation);
 
@@ -2357,6 +2364,10 @@ void GFXDevice::logPerformanceInfo()
 uint64_t GFXDevice::getFrameCount() { return pimpl->FRAMECOUNT; }
 
 /* Waits until all the active GPU queues have finished working */
-void GFXDevice::waitIdle() { vkDeviceWaitIdle(pimpl->device.device); }
+void GFXDevice::waitIdle()
+{
+    std::lock_guard lock(pimpl->queueMutex);
+    vkDeviceWaitIdle(pimpl->device.device);
+}
 
 } // namespace engine
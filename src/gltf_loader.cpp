@@ -8,6 +8,7 @@
 #include "component_mesh.h"
 #include "component_transform.h"
 #include "files.h"
+#include "job_system.h"
 #include "log.h"
 #include "renderer.h"
 #include "resource_material.h"
@@ -341,254 +342,278 @@ engine::Entity loadGLTF(Scene& scene, const std::string& path, bool isStatic)
 
     /* load all meshes found in model */
 
-    struct EnginePrimitive {
-        std::shared_ptr<Mesh> mesh;
-        std::shared_ptr<Material> material;
-        AABB aabb;
+    // Building the vertices of each primitive (including tangent generation) is independent, so it is spread across the job system.
+    // The meshes are then created on the GPU from this thread.
+    struct PrimitiveGeometry {
+        size_t mesh_index;
+        const tg::Primitive* primitive;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
     };
-    std::vector<std::vector<EnginePrimitive>> primitive_arrays{}; // sub-array is all primitives for a given mesh
-    primitive_arrays.reserve(model.meshes.size());
-    for (const tg::Mesh& mesh : model.meshes) {
-        auto& primitive_array = primitive_arrays.emplace_back();
-        for (const tg::Primitive& primitive : mesh.primitives) {
+    std::vector<PrimitiveGeometry> geometries{};
+    for (size_t mesh_index = 0; mesh_index < model.meshes.size(); ++mesh_index) {
+        for (const tg::Primitive& primitive : model.meshes[mesh_index].primitives) {
+            // primitives without positions are skipped
             if (primitive.attributes.contains("POSITION")) {
-                const tg::Accessor& pos_accessor = model.accessors.at(primitive.attributes.at("POSITION"));
+                geometries.push_back(PrimitiveGeometry{.mesh_index = mesh_index, .primitive = &primitive, .vertices = {}, .indices = {}});
+            }
+        }
+    }
 
-                const size_t original_num_vertices = pos_accessor.count;
+    const auto build_geometries = [&](size_t begin, size_t end) {
+        for (size_t geometry_index = begin; geometry_index < end; ++geometry_index) {
+            const tg::Mesh& mesh = model.meshes[geometries[geometry_index].mesh_index];
+            const tg::Primitive& primitive = *geometries[geometry_index].primitive;
+            std::vector<Vertex>& vertices = geometries[geometry_index].vertices;
+            std::vector<uint32_t>& indices = geometries[geometry_index].indices;
 
-                bool generate_tangents = false; // generating tangents creates a new index list and therefore all attribute accessors must be reassigned
+            const tg::Accessor& pos_accessor = model.accessors.at(primitive.attributes.at("POSITION"));
 
-                // these checks are probably unneccesary assuming a valid glTF file
-                // if (pos_accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) throw std::runtime_error("Position att. must be float!");
-                // if (pos_accessor.type != 3) throw std::runtime_error("Position att. dim. must be 3!");
+            const size_t original_num_vertices = pos_accessor.count;
 
-                const tg::BufferView& pos_bufferview = model.bufferViews.at(pos_accessor.bufferView);
-                const tg::Buffer& pos_buffer = model.buffers.at(pos_bufferview.buffer);
+            bool generate_tangents = false; // generating tangents creates a new index list and therefore all attribute accessors must be reassigned
 
-                Attribute<glm::vec3> positions{.buffer = pos_buffer.data.data(),
-                                               .offset = pos_accessor.byteOffset + pos_bufferview.byteOffset,
-                                               .stride = static_cast<size_t>(pos_accessor.ByteStride(pos_bufferview))};
+            // these checks are probably unneccesary assuming a valid glTF file
+            // if (pos_accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) throw std::runtime_error("Position att. must be float!");
+            // if (pos_accessor.type != 3) throw std::runtime_error("Position att. dim. must be 3!");
 
-                Attribute<glm::vec3> normals{};
-                if (primitive.attributes.contains("NORMAL")) {
-                    const tg::Accessor& norm_accessor = model.accessors.at(primitive.attributes.at("NORMAL"));
-                    const tg::BufferView& norm_bufferview = model.bufferViews.at(norm_accessor.bufferView);
-                    const tg::Buffer& norm_buffer = model.buffers.at(norm_bufferview.buffer);
-                    normals.buffer = norm_buffer.data.data();
-                    normals.offset = norm_accessor.byteOffset + norm_bufferview.byteOffset;
-                    normals.stride = static_cast<size_t>(norm_accessor.ByteStride(norm_bufferview));
-                }
-                else {
-                    // TODO: generate flat normals
-                    throw std::runtime_error(std::string("No normals found in primitive from ") + mesh.name);
-                }
+            const tg::BufferView& pos_bufferview = model.bufferViews.at(pos_accessor.bufferView);
+            const tg::Buffer& pos_buffer = model.buffers.at(pos_bufferview.buffer);
 
-                Attribute<glm::vec4> tangents{};
-                if (primitive.attributes.contains("TANGENT")) {
-                    const tg::Accessor& tang_accessor = model.accessors.at(primitive.attributes.at("TANGENT"));
-                    const tg::BufferView& tang_bufferview = model.bufferViews.at(tang_accessor.bufferView);
-                    const tg::Buffer& tang_buffer = model.buffers.at(tang_bufferview.buffer);
-                    tangents.buffer = tang_buffer.data.data();
-                    tangents.offset = tang_accessor.byteOffset + tang_bufferview.byteOffset;
-                    tangents.stride = static_cast<size_t>(tang_accessor.ByteStride(tang_bufferview));
-                }
-                else {
-                    generate_tangents = true;
-                }
+            Attribute<glm::vec3> positions{.buffer = pos_buffer.data.data(),
+                                           .offset = pos_accessor.byteOffset + pos_bufferview.byteOffset,
+                                           .stride = static_cast<size_t>(pos_accessor.ByteStride(pos_bufferview))};
 
-                // UV0
-                Attribute<glm::vec2> uv0s{};
-                if (primitive.attributes.contains("TEXCOORD_0")) {
-                    const tg::Accessor& uv0_accessor = model.accessors.at(primitive.attributes.at("TEXCOORD_0"));
-                    const tg::BufferView& uv0_bufferview = model.bufferViews.at(uv0_accessor.bufferView);
-                    const tg::Buffer& uv0_buffer = model.buffers.at(uv0_bufferview.buffer);
-                    uv0s.buffer = uv0_buffer.data.data();
-                    uv0s.offset = uv0_accessor.byteOffset + uv0_bufferview.byteOffset;
-                    uv0s.stride = static_cast<size_t>(uv0_accessor.ByteStride(uv0_bufferview));
-                }
-                else {
-                    // TODO: Possibly create a shader variant that doesn't need UVs?
-                    throw std::runtime_error(std::string("No TEXCOORD_0 found in primitive from ") + mesh.name);
-                }
+            Attribute<glm::vec3> normals{};
+            if (primitive.attributes.contains("NORMAL")) {
+                const tg::Accessor& norm_accessor = model.accessors.at(primitive.attributes.at("NORMAL"));
+                const tg::BufferView& norm_bufferview = model.bufferViews.at(norm_accessor.bufferView);
+                const tg::Buffer& norm_buffer = model.buffers.at(norm_bufferview.buffer);
+                normals.buffer = norm_buffer.data.data();
+                normals.offset = norm_accessor.byteOffset + norm_bufferview.byteOffset;
+                normals.stride = static_cast<size_t>(norm_accessor.ByteStride(norm_bufferview));
+            }
+            else {
+                // TODO: generate flat normals
+                throw std::runtime_error(std::string("No normals found in primitive from ") + mesh.name);
+            }
 
-                // Indices
-                const tg::Accessor& indices_accessor = model.accessors.at(primitive.indices);
-                const tg::BufferView& indices_bufferview = model.bufferViews.at(indices_accessor.bufferView);
-                const tg::Buffer& indices_buffer = model.buffers.at(indices_bufferview.buffer);
-                const uint8_t* const indices_data_start = indices_buffer.data.data() + indices_accessor.byteOffset + indices_bufferview.byteOffset;
-
-                const size_t num_indices = indices_accessor.count;
-                std::vector<uint32_t> indices;
-                indices.reserve(num_indices);
-
-                // TODO: natively support indices of these sizes instead of having to convert to uint32
-                if (indices_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
-                    for (size_t i = 0; i < num_indices; ++i) {
-                        indices.push_back(*reinterpret_cast<const uint8_t*>(&indices_data_start[i * 1]));
-                    }
-                }
-                else if (indices_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-                    for (size_t i = 0; i < num_indices; ++i) {
-                        indices.push_back(*reinterpret_cast<const uint16_t*>(&indices_data_start[i * 2]));
-                    }
+            Attribute<glm::vec4> tangents{};
+            if (primitive.attributes.contains("TANGENT")) {
+                const tg::Accessor& tang_accessor = model.accessors.at(primitive.attributes.at("TANGENT"));
+                const tg::BufferView& tang_bufferview = model.bufferViews.at(tang_accessor.bufferView);
+                const tg::Buffer& tang_buffer = model.buffers.at(tang_bufferview.buffer);
+                tangents.buffer = tang_buffer.data.data();
+                tangents.offset = tang_accessor.byteOffset + tang_bufferview.byteOffset;
+                tangents.stride = static_cast<size_t>(tang_accessor.ByteStride(tang_bufferview));
+            }
+            else {
+                generate_tangents = true;
+            }
+
+            // UV0
+            Attribute<glm::vec2> uv0s{};
+            if (primitive.attributes.contains("TEXCOORD_0")) {
+                const tg::Accessor& uv0_accessor = model.accessors.at(primitive.attributes.at("TEXCOORD_0"));
+                const tg::BufferView& uv0_bufferview = model.bufferViews.at(uv0_accessor.bufferView);
+                const tg::Buffer& uv0_buffer = model.buffers.at(uv0_bufferview.buffer);
+                uv0s.buffer = uv0_buffer.data.data();
+                uv0s.offset = uv0_accessor.byteOffset + uv0_bufferview.byteOffset;
+                uv0s.stride = static_cast<size_t>(uv0_accessor.ByteStride(uv0_bufferview));
+            }
+            else {
+                // TODO: Possibly create a shader variant that doesn't need UVs?
+                throw std::runtime_error(std::string("No TEXCOORD_0 found in primitive from ") + mesh.name);
+            }
+
+            // Indices
+            const tg::Accessor& indices_accessor = model.accessors.at(primitive.indices);
+            const tg::BufferView& indices_bufferview = model.bufferViews.at(indices_accessor.bufferView);
+            const tg::Buffer& indices_buffer = model.buffers.at(indices_bufferview.buffer);
+            const uint8_t* const indices_data_start = indices_buffer.data.data() + indices_accessor.byteOffset + indices_bufferview.byteOffset;
+
+            const size_t num_indices = indices_accessor.count;
+            indices.reserve(num_indices);
+
+            // TODO: natively support indices of these sizes instead of having to convert to uint32
+            if (indices_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
+                for (size_t i = 0; i < num_indices; ++i) {
+                    indices.push_back(*reinterpret_cast<const uint8_t*>(&indices_data_start[i * 1]));
                 }
-                else if (indices_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
-                    for (size_t i = 0; i < num_indices; ++i) {
-                        indices.push_back(*reinterpret_cast<const uint32_t*>(&indices_data_start[i * 4]));
-                    }
+            }
+            else if (indices_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+                for (size_t i = 0; i < num_indices; ++i) {
+                    indices.push_back(*reinterpret_cast<const uint16_t*>(&indices_data_start[i * 2]));
                 }
-                else {
-                    throw std::runtime_error(std::string("Invalid index buffer in primtive from: ") + mesh.name);
+            }
+            else if (indices_accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
+                for (size_t i = 0; i < num_indices; ++i) {
+                    indices.push_back(*reinterpret_cast<const uint32_t*>(&indices_data_start[i * 4]));
                 }
+            }
+            else {
+                throw std::runtime_error(std::string("Invalid index buffer in primtive from: ") + mesh.name);
+            }
 
-                std::vector<Vertex> vertices;
-
-                if (generate_tangents) {
-                    LOG_DEBUG("Generating tangents...");
-                    LOG_TRACE("Tangent gen: vtx count before = {} idx count before = {}", original_num_vertices, num_indices);
-                    // generate tangents if they're not in the file
-                    // manually generating tangents directly with MikkTSpace instead of util::GenTangents() in order to directly access glTF vertex attributes
-                    struct MeshData {
-                        Attribute<glm::vec3>* positions;
-                        Attribute<glm::vec3>* normals;
-                        Attribute<glm::vec2>* uvs;
-                        const uint32_t* indices;
-                        size_t num_indices;
-                        std::vector<Vertex>* new_vertices;
-                    };
-
-                    MeshData meshData{};
-                    meshData.positions = &positions;
-                    meshData.normals = &normals;
-                    meshData.uvs = &uv0s;
-                    meshData.indices = indices.data();
-                    meshData.num_indices = num_indices;
-                    meshData.new_vertices = &vertices;
-                    vertices.resize(num_indices);
-
-                    SMikkTSpaceInterface mts_interface{};
-                    mts_interface.m_getNumFaces = [](const SMikkTSpaceContext* pContext) -> int {
-                        const MeshData* meshData = static_cast<const MeshData*>(pContext->m_pUserData);
-                        assert(meshData->num_indices % 3 == 0);
-                        return static_cast<int>(meshData->num_indices / 3);
-                    };
-                    mts_interface.m_getNumVerticesOfFace = [](const SMikkTSpaceContext*, const int) -> int { return 3; };
-                    mts_interface.m_getPosition = [](const SMikkTSpaceContext* pContext, float fvPosOut[], const int iFace, const int iVert) -> void {
-                        const MeshData* const meshData = static_cast<const MeshData*>(pContext->m_pUserData);
-                        const size_t i = static_cast<size_t>(iFace) * 3 + static_cast<size_t>(iVert);
-                        assert(i < meshData->num_indices);
-                        const size_t vertex_index = meshData->indices[i];
-                        const glm::vec3 pos = meshData->positions->operator[](vertex_index);
-                        fvPosOut[0] = pos.x;
-                        fvPosOut[1] = pos.y;
-                        fvPosOut[2] = pos.z;
-                    };
-                    mts_interface.m_getNormal = [](const SMikkTSpaceContext* pContext, float fvNormOut[], const int iFace, const int iVert) -> void {
-                        const MeshData* const meshData = static_cast<const MeshData*>(pContext->m_pUserData);
-                        const size_t i = static_cast<size_t>(iFace) * 3 + static_cast<size_t>(iVert);
-                        assert(i < meshData->num_indices);
-                        const size_t vertex_index = meshData->indices[i];
-                        const glm::vec3 norm = meshData->normals->operator[](vertex_index);
-                        fvNormOut[0] = norm.x;
-                        fvNormOut[1] = norm.y;
-                        fvNormOut[2] = norm.z;
-                    };
-                    mts_interface.m_getTexCoord = [](const SMikkTSpaceContext* pContext, float fvTexcOut[], const int iFace, const int iVert) -> void {
-                        const MeshData* const meshData = static_cast<const MeshData*>(pContext->m_pUserData);
-                        const size_t i = static_cast<size_t>(iFace) * 3 + static_cast<size_t>(iVert);
-                        assert(i < meshData->num_indices);
-                        const size_t vertex_index = meshData->indices[i];
-                        const glm::vec2 uv = meshData->uvs->operator[](vertex_index);
-                        fvTexcOut[0] = uv.x;
-                        fvTexcOut[1] = uv.y;
-                    };
-                    mts_interface.m_setTSpaceBasic = [](const SMikkTSpaceContext* pContext, const float fvTangent[], const float fSign, const int iFace,
-                                                        const int iVert) -> void {
-                        MeshData* const meshData = static_cast<MeshData*>(pContext->m_pUserData);
-                        const size_t i = static_cast<size_t>(iFace) * 3 + static_cast<size_t>(iVert);
-                        assert(i < meshData->num_indices);
-                        const size_t vertex_index = meshData->indices[i];
-
-                        Vertex& new_v = meshData->new_vertices->operator[](i);
-
-                        new_v.pos = meshData->positions->operator[](vertex_index);
-                        new_v.norm = meshData->normals->operator[](vertex_index);
-                        new_v.uv = meshData->uvs->operator[](vertex_index);
-                        new_v.tangent.x = fvTangent[0];
-                        new_v.tangent.y = fvTangent[1];
-                        new_v.tangent.z = fvTangent[2];
-                        new_v.tangent.w = fSign;
-                    };
-                    SMikkTSpaceContext mts_context{};
-                    mts_context.m_pInterface = &mts_interface;
-                    mts_context.m_pUserData = &meshData;
-
-                    bool tan_result = genTangSpaceDefault(&mts_context);
-                    if (tan_result == false) throw std::runtime_error("Failed to generate tangents!");
-
-                    // vertices now contains new vertices (possibly with duplicates)
-                    // use weldmesh to generate new index list without duplicates
-
-                    std::vector<int> remap_table(num_indices);        // initialised to zeros
-                    std::vector<Vertex> vertex_data_out(num_indices); // initialised to zeros
-
-                    const int num_unq_vertices = WeldMesh(remap_table.data(), reinterpret_cast<float*>(vertex_data_out.data()),
-                                                          reinterpret_cast<float*>(vertices.data()), static_cast<int>(num_indices), Vertex::floatsPerVertex());
-                    assert(num_unq_vertices >= 0);
-
-                    // get new vertices into the vector
-                    vertices.resize(static_cast<size_t>(num_unq_vertices));
-                    for (size_t i = 0; i < static_cast<size_t>(num_unq_vertices); ++i) {
-                        vertices[i] = vertex_data_out[i];
-                    }
-
-                    // get new indices into the vector
-                    indices.resize(num_indices); // redundant, for clarity
-                    for (size_t i = 0; i < num_indices; ++i) {
-                        assert(remap_table[i] >= 0);
-                        indices[i] = static_cast<uint32_t>(remap_table[i]);
-                    }
-
-                    LOG_TRACE("Tangent gen: vtx count after = {} idx count after = {}", vertices.size(), indices.size());
-                }
-                else {
-                    // combine vertices into one array
-                    vertices.clear();
-                    vertices.reserve(original_num_vertices);
-                    for (size_t i = 0; i < original_num_vertices; ++i) {
-                        Vertex v{.pos = positions[i], .norm = normals[i], .tangent = tangents[i], .uv = uv0s[i]};
-                        vertices.push_back(v);
-                    }
+            if (generate_tangents) {
+                LOG_DEBUG("Generating tangents...");
+                LOG_TRACE("Tangent gen: vtx count before = {} idx count before = {}", original_num_vertices, num_indices);
+                // generate tangents if they're not in the file
+                // manually generating tangents directly with MikkTSpace instead of util::GenTangents() in order to directly access glTF vertex attributes
+                struct MeshData {
+                    Attribute<glm::vec3>* positions;
+                    Attribute<glm::vec3>* normals;
+                    Attribute<glm::vec2>* uvs;
+                    const uint32_t* indices;
+                    size_t num_indices;
+                    std::vector<Vertex>* new_vertices;
+                };
+
+                MeshData meshData{};
+                meshData.positions = &positions;
+                meshData.normals = &normals;
+                meshData.uvs = &uv0s;
+                meshData.indices = indices.data();
+                meshData.num_indices = num_indices;
+                meshData.new_vertices = &vertices;
+                vertices.resize(num_indices);
+
+                SMikkTSpaceInterface mts_interface{};
+                mts_interface.m_getNumFaces = [](const SMikkTSpaceContext* pContext) -> int {
+                    const MeshData* meshData = static_cast<const MeshData*>(pContext->m_pUserData);
+                    assert(meshData->num_indices % 3 == 0);
+                    return static_cast<int>(meshData->num_indices / 3);
+                };
+                mts_interface.m_getNumVerticesOfFace = [](const SMikkTSpaceContext*, const int) -> int { return 3; };
+                mts_interface.m_getPosition = [](const SMikkTSpaceContext* pContext, float fvPosOut[], const int iFace, const int iVert) -> void {
+                    const MeshData* const meshData = static_cast<const MeshData*>(pContext->m_pUserData);
+                    const size_t i = static_cast<size_t>(iFace) * 3 + static_cast<size_t>(iVert);
+                    assert(i < meshData->num_indices);
+                    const size_t vertex_index = meshData->indices[i];
+                    const glm::vec3 pos = meshData->positions->operator[](vertex_index);
+                    fvPosOut[0] = pos.x;
+                    fvPosOut[1] = pos.y;
+                    fvPosOut[2] = pos.z;
+                };
+                mts_interface.m_getNormal = [](const SMikkTSpaceContext* pContext, float fvNormOut[], const int iFace, const int iVert) -> void {
+                    const MeshData* const meshData = static_cast<const MeshData*>(pContext->m_pUserData);
+                    const size_t i = static_cast<size_t>(iFace) * 3 + static_cast<size_t>(iVert);
+                    assert(i < meshData->num_indices);
+                    const size_t vertex_index = meshData->indices[i];
+                    const glm::vec3 norm = meshData->normals->operator[](vertex_index);
+                    fvNormOut[0] = norm.x;
+                    fvNormOut[1] = norm.y;
+                    fvNormOut[2] = norm.z;
+                };
+                mts_interface.m_getTexCoord = [](const SMikkTSpaceContext* pContext, float fvTexcOut[], const int iFace, const int iVert) -> void {
+                    const MeshData* const meshData = static_cast<const MeshData*>(pContext->m_pUserData);
+                    const size_t i = static_cast<size_t>(iFace) * 3 + static_cast<size_t>(iVert);
+                    assert(i < meshData->num_indices);
+                    const size_t vertex_index = meshData->indices[i];
+                    const glm::vec2 uv = meshData->uvs->operator[](vertex_index);
+                    fvTexcOut[0] = uv.x;
+                    fvTexcOut[1] = uv.y;
+                };
+                mts_interface.m_setTSpaceBasic = [](const SMikkTSpaceContext* pContext, const float fvTangent[], const float fSign, const int iFace,
+                                                    const int iVert) -> void {
+                    MeshData* const meshData = static_cast<MeshData*>(pContext->m_pUserData);
+                    const size_t i = static_cast<size_t>(iFace) * 3 + static_cast<size_t>(iVert);
+                    assert(i < meshData->num_indices);
+                    const size_t vertex_index = meshData->indices[i];
+
+                    Vertex& new_v = meshData->new_vertices->operator[](i);
+
+                    new_v.pos = meshData->positions->operator[](vertex_index);
+                    new_v.norm = meshData->normals->operator[](vertex_index);
+                    new_v.uv = meshData->uvs->operator[](vertex_index);
+                    new_v.tangent.x = fvTangent[0];
+                    new_v.tangent.y = fvTangent[1];
+                    new_v.tangent.z = fvTangent[2];
+                    new_v.tangent.w = fSign;
+                };
+                SMikkTSpaceContext mts_context{};
+                mts_context.m_pInterface = &mts_interface;
+                mts_context.m_pUserData = &meshData;
+
+                bool tan_result = genTangSpaceDefault(&mts_context);
+                if (tan_result == false) throw std::runtime_error("Failed to generate tangents!");
+
+                // vertices now contains new vertices (possibly with duplicates)
+                // use weldmesh to generate new index list without duplicates
+
+                std::vector<int> remap_table(num_indices);        // initialised to zeros
+                std::vector<Vertex> vertex_data_out(num_indices); // initialised to zeros
+
+                const int num_unq_vertices = WeldMesh(remap_table.data(), reinterpret_cast<float*>(vertex_data_out.data()),
+                                                      reinterpret_cast<float*>(vertices.data()), static_cast<int>(num_indices), Vertex::floatsPerVertex());
+                assert(num_unq_vertices >= 0);
+
+                // get new vertices into the vector
+                vertices.resize(static_cast<size_t>(num_unq_vertices));
+                for (size_t i = 0; i < static_cast<size_t>(num_unq_vertices); ++i) {
+                    vertices[i] = vertex_data_out[i];
                 }
 
-                // generate mesh on GPU
-                std::shared_ptr<Mesh> engine_mesh = std::make_shared<Mesh>(scene.app()->getRenderer()->GetDevice(), vertices, indices);
-
-                // get material
-                std::shared_ptr<Material> engine_material = nullptr;
-                if (primitive.material != -1) {
-                    engine_material = materials.at(primitive.material);
-                }
-                else {
-                    engine_material = scene.app()->getResource<Material>("builtin.default");
+                // get new indices into the vector
+                indices.resize(num_indices); // redundant, for clarity
+                for (size_t i = 0; i < num_indices; ++i) {
+                    assert(remap_table[i] >= 0);
+                    indices[i] = static_cast<uint32_t>(remap_table[i]);
                 }
 
-                // get AABB
-                AABB box{};
-                box.min.x = static_cast<float>(pos_accessor.minValues.at(0));
-                box.min.y = static_cast<float>(pos_accessor.minValues.at(1));
-                box.min.z = static_cast<float>(pos_accessor.minValues.at(2));
-                box.max.x = static_cast<float>(pos_accessor.maxValues.at(0));
-                box.max.y = static_cast<float>(pos_accessor.maxValues.at(1));
-                box.max.z = static_cast<float>(pos_accessor.maxValues.at(2));
-
-                primitive_array.emplace_back(engine_mesh, engine_material, box);
+                LOG_TRACE("Tangent gen: vtx count after = {} idx count after = {}", vertices.size(), indices.size());
             }
             else {
-                // skip primitive's rendering
-                continue;
+                // combine vertices into one array
+                vertices.clear();
+                vertices.reserve(original_num_vertices);
+                for (size_t i = 0; i < original_num_vertices; ++i) {
+                    Vertex v{.pos = positions[i], .norm = normals[i], .tangent = tangents[i], .uv = uv0s[i]};
+                    vertices.push_back(v);
+                }
             }
         }
+    };
+    // A scene being preloaded has no job system. Its geometry is then built on this thread rather than queued for the game loop's threads.
+    if (JobSystem* job_system = scene.job_system()) {
+        job_system->parallelFor(geometries.size(), 1, build_geometries);
+    }
+    else {
+        build_geometries(0, geometries.size());
+    }
+
+    struct EnginePrimitive {
+        std::shared_ptr<Mesh> mesh;
+        std::shared_ptr<Material> material;
+        AABB aabb;
+    };
+    std::vector<std::vector<EnginePrimitive>> primitive_arrays(model.meshes.size()); // sub-array is all primitives for a given mesh
+    for (const PrimitiveGeometry& geometry : geometries) {
+        const tg::Primitive& primitive = *geometry.primitive;
+        const tg::Accessor& pos_accessor = model.accessors.at(primitive.attributes.at("POSITION"));
+
+        // generate mesh on GPU
+        std::shared_ptr<Mesh> engine_mesh = std::make_shared<Mesh>(scene.app()->getRenderer()->GetDevice(), geometry.vertices, geometry.indices);
+
+        // get material
+        std::shared_ptr<Material> engine_material = nullptr;
+        if (primitive.material != -1) {
+            engine_material = materials.at(primitive.material);
+        }
+        else {
+            engine_material = scene.app()->getResource<Material>("builtin.default");
+        }
+
+        // get AABB
+        AABB box{};
+        box.min.x = static_cast<float>(pos_accessor.minValues.at(0));
+        box.min.y = static_cast<float>(pos_accessor.minValues.at(1));
+        box.min.z = static_cast<float>(pos_accessor.minValues.at(2));
+        box.max.x = static_cast<float>(pos_accessor.maxValues.at(0));
+        box.max.y = static_cast<float>(pos_accessor.maxValues.at(1));
+        box.max.z = static_cast<float>(pos_accessor.maxValues.at(2));
+
+        primitive_arrays[geometry.mesh_index].emplace_back(engine_mesh, engine_material, box);
     }
 
     /* now create the entities and traverse the glTF scene hierarchy */
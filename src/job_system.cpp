@@ -0,0 +1,226 @@
+#include "job_system.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <string>
+
+#include "log.h"
+
+namespace engine {
+
+static thread_local unsigned int g_thread_index = JobSystem::EXTERNAL_THREAD_INDEX;
+
+static void pinThreadToCore(std::thread& thread, unsigned int core)
+{
+#ifdef _WIN32
+    if (SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{1} << core) == 0) {
+        LOG_WARN("Failed to set affinity of job thread to core {}", core);
+    }
+#elif defined(__linux__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core, &cpu_set);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpu_set) != 0) {
+        LOG_WARN("Failed to set affinity of job thread to core {}", core);
+    }
+#else
+    (void)thread;
+    (void)core;
+    LOG_WARN("Thread affinity is not supported on this platform");
+#endif
+}
+
+JobSystem::JobSystem(JobSystemInfo info)
+{
+    g_thread_index = 0;
+
+    unsigned int worker_count = info.worker_count;
+    if (worker_count == 0) {
+        const unsigned int hardware_threads = std::thread::hardware_concurrency();
+        worker_count = (hardware_threads > 1) ? hardware_threads - 1 : 0;
+    }
+
+    for (unsigned int i = 0; i < worker_count + 1; ++i) {
+        m_queues.emplace_back(std::make_unique<JobQueue>());
+    }
+    m_workers.reserve(worker_count);
+    for (unsigned int i = 1; i <= worker_count; ++i) {
+        m_workers.emplace_back(&JobSystem::workerLoop, this, i);
+        if (info.pin_threads) {
+            pinThreadToCore(m_workers.back(), i % std::max(1u, std::thread::hardware_concurrency()));
+        }
+    }
+
+    LOG_DEBUG("Started job system with {} worker threads", worker_count);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_shutting_down = true;
+    }
+    m_wake_condition.notify_all();
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+unsigned int JobSystem::getThreadIndex() { return g_thread_index; }
+
+void JobSystem::run(std::function<void()> job, JobCounter* counter)
+{
+    if (counter) {
+        counter->m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    push(Job{std::move(job), counter});
+}
+
+void JobSystem::runAfter(JobCounter& dependency, std::function<void()> job, JobCounter* counter)
+{
+    {
+        std::lock_guard lock(dependency.m_mutex);
+        if (dependency.isDone() == false) {
+            if (counter) {
+                counter->m_count.fetch_add(1, std::memory_order_relaxed);
+            }
+            dependency.m_continuations.push_back(JobCounter::Continuation{std::move(job), counter});
+            return;
+        }
+    }
+    run(std::move(job), counter);
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    const unsigned int thread_index = g_thread_index;
+    while (counter.isDone() == false) {
+        Job job{};
+        if (thread_index < m_queues.size() && tryGetJob(thread_index, job)) {
+            execute(job);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+
+    std::exception_ptr exception{};
+    {
+        std::lock_guard lock(counter.m_mutex);
+        std::swap(exception, counter.m_exception);
+    }
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+void JobSystem::push(Job job)
+{
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_queued_job_count.fetch_add(1, std::memory_order_release);
+    }
+
+    // jobs from threads outside the job system go to the workers, leaving the owning thread's queue to its own jobs
+    unsigned int thread_index = g_thread_index;
+    if (thread_index >= m_queues.size()) {
+        thread_index = m_workers.empty() ? 0 : 1 + m_next_external_queue.fetch_add(1, std::memory_order_relaxed) % getWorkerCount();
+    }
+    {
+        std::lock_guard lock(m_queues[thread_index]->mutex);
+        m_queues[thread_index]->jobs.push_back(std::move(job));
+    }
+
+    m_wake_condition.notify_one();
+}
+
+void JobSystem::workerLoop(unsigned int thread_index)
+{
+    g_thread_index = thread_index;
+
+    while (true) {
+        Job job{};
+        if (tryGetJob(thread_index, job)) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock lock(m_sleep_mutex);
+        m_wake_condition.wait(lock, [this]() { return m_shutting_down || m_queued_job_count.load(std::memory_order_acquire) != 0; });
+        if (m_shutting_down) return;
+    }
+}
+
+bool JobSystem::tryGetJob(unsigned int thread_index, Job& job)
+{
+    if (m_queued_job_count.load(std::memory_order_acquire) == 0) return false;
+
+    // newest job from this thread's queue first, as its data is most likely to be in cache
+    {
+        JobQueue& own_queue = *m_queues[thread_index];
+        std::lock_guard lock(own_queue.mutex);
+        if (own_queue.jobs.empty() == false) {
+            job = std::move(own_queue.jobs.back());
+            own_queue.jobs.pop_back();
+            m_queued_job_count.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // otherwise steal the oldest job from another thread
+    for (size_t i = 1; i < m_queues.size(); ++i) {
+        JobQueue& victim_queue = *m_queues[(thread_index + i) % m_queues.size()];
+        std::lock_guard lock(victim_queue.mutex);
+        if (victim_queue.jobs.empty() == false) {
+            job = std::move(victim_queue.jobs.front());
+            victim_queue.jobs.pop_front();
+            m_queued_job_count.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::execute(Job& job)
+{
+    try {
+        job.func();
+    }
+    catch (...) {
+        if (job.counter) {
+            std::lock_guard lock(job.counter->m_mutex);
+            if (job.counter->m_exception == nullptr) {
+                job.counter->m_exception = std::current_exception();
+            }
+        }
+        else {
+            LOG_ERROR("Uncounted job threw an exception");
+        }
+    }
+    finishJob(job.counter);
+}
+
+void JobSystem::finishJob(JobCounter* counter)
+{
+    if (counter == nullptr) return;
+
+    std::vector<JobCounter::Continuation> continuations{};
+    {
+        // the lock stops runAfter() from adding a continuation after they have been taken
+        std::lock_guard lock(counter->m_mutex);
+        if (counter->m_count.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        std::swap(continuations, counter->m_continuations);
+    }
+    for (JobCounter::Continuation& continuation : continuations) {
+        // the continuation was already counted by runAfter()
+        push(Job{std::move(continuation.job), continuation.counter});
+    }
+}
+
+} // namespace engine
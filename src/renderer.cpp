@@ -240,7 +240,7 @@ Renderer::~Renderer()
 
     device_->destroyPipeline(debug_rendering_things_.pipeline);
 
-    for (const auto& [info, sampler] : samplers) {
+    for (const auto& [info, sampler] : samplers_) {
         device_->destroySampler(sampler);
     }
     device_->destroyDescriptorSetLayout(material_set_layout);
@@ -252,6 +252,16 @@ Renderer::~Renderer()
     device_->destroyDescriptorSetLayout(global_uniform.layout);
 }
 
+const gfx::Sampler* Renderer::GetOrCreateSampler(const gfx::SamplerInfo& info)
+{
+    std::lock_guard lock(samplers_mutex_);
+    auto it = samplers_.find(info);
+    if (it == samplers_.end()) {
+        it = samplers_.emplace(info, device_->createSampler(info)).first;
+    }
+    return it->second;
+}
+
 void Renderer::Render(bool window_is_resized, glm::mat4 camera_transform, const RenderList* static_list, const RenderList* dynamic_list,
                       const std::vector<DebugLine>& debug_lines)
 {
@@ -2,6 +2,7 @@
 
 #include "renderer.h"
 #include "resource_shader.h"
+#include "util.h"
 
 namespace engine {
 
@@ -31,4 +32,13 @@ void Material::setOcclusionRoughnessMetallicTexture(std::shared_ptr<Texture> tex
     m_texture_occlusion_roughness_metallic = texture;
 }
 
+uint64_t Material::getContentHash() const
+{
+    uint64_t hash = m_shader->GetContentHash();
+    for (const Texture* texture : {m_texture_albedo.get(), m_texture_normal.get(), m_texture_occlusion_roughness_metallic.get()}) {
+        hash = HashCombine(hash, texture ? texture->GetContentHash() : 0);
+    }
+    return hash;
+}
+
 } // namespace engine
@@ -2,6 +2,7 @@
 
 #include "log.h"
 #include "gfx_device.h"
+#include "util.h"
 
 namespace engine {
 
@@ -34,6 +35,7 @@ void Mesh::initMesh(const std::vector<Vertex>& vertices, const std::vector<uint3
     m_vb = m_gfx->createBuffer(gfx::BufferType::VERTEX, vertices.size() * sizeof(Vertex), vertices.data());
     m_ib = m_gfx->createBuffer(gfx::BufferType::INDEX, indices.size() * sizeof(uint32_t), indices.data());
     m_count = (uint32_t)indices.size();
+    m_content_hash = HashBytes(indices.data(), indices.size() * sizeof(uint32_t), HashBytes(vertices.data(), vertices.size() * sizeof(Vertex)));
     LOG_DEBUG("Created mesh, vertices: {}, indices: {}", vertices.size(), indices.size());
 }
 
@@ -4,6 +4,7 @@
 #include "gfx_device.h"
 #include "log.h"
 #include "renderer.h"
+#include "util.h"
 
 #include <glm/mat4x4.hpp>
 
@@ -58,6 +59,14 @@ Shader::Shader(Renderer* renderer, const std::string& vertPath, const std::strin
 
   pipeline_ = gfx_->createPipeline(info);
 
+  const uint64_t setting_bits =
+      (uint64_t{settings.vertexParams.has_normal} << 0) | (uint64_t{settings.vertexParams.has_tangent} << 1) |
+      (uint64_t{settings.vertexParams.has_color} << 2) | (uint64_t{settings.vertexParams.has_uv0} << 3) |
+      (uint64_t{settings.alpha_blending} << 4) | (uint64_t{settings.cull_backface} << 5) |
+      (uint64_t{settings.write_z} << 6) | (static_cast<uint64_t>(settings.render_order) << 8);
+  content_hash_ = HashBytes(fragPath.data(), fragPath.size(), HashBytes(vertPath.data(), vertPath.size()));
+  content_hash_ = HashCombine(content_hash_, setting_bits);
+
   LOG_DEBUG("Created shader: {}, pipeline: {}", vertPath,
            static_cast<const void*>(pipeline_));
 }
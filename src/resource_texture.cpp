@@ -4,6 +4,7 @@
 #include "files.h"
 #include "log.h"
 #include "renderer.h"
+#include "util.h"
 
 #include <vector>
 
@@ -11,14 +12,15 @@ namespace engine {
 
 Texture::Texture(Renderer* renderer, const uint8_t* bitmap, int width, int height, gfx::SamplerInfo samplerInfo, bool srgb) : gfx_(renderer->GetDevice())
 {
-    if (renderer->samplers.contains(samplerInfo) == false) {
-        renderer->samplers.insert(std::make_pair(samplerInfo, gfx_->createSampler(samplerInfo)));
-    }
-
     gfx::ImageFormat format = srgb ? gfx::ImageFormat::SRGB : gfx::ImageFormat::LINEAR;
 
     image_ = gfx_->createImage(width, height, format, bitmap);
-    sampler_ = renderer->samplers.at(samplerInfo);
+    sampler_ = renderer->GetOrCreateSampler(samplerInfo);
+
+    content_hash_ = HashBytes(bitmap, static_cast<size_t>(width) * static_cast<size_t>(height) * 4);
+    content_hash_ = HashCombine(content_hash_, (static_cast<uint64_t>(width) << 32) | static_cast<uint32_t>(height));
+    content_hash_ = HashCombine(content_hash_, std::hash<gfx::SamplerInfo>{}(samplerInfo));
+    content_hash_ = HashCombine(content_hash_, srgb);
 
     LOG_DEBUG("Created texture: width: {}, height: {}", width, height);
 }
@@ -1,5 +1,10 @@
 #include "scene.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "application.h"
 #include "component_transform.h"
 #include "component_collider.h"
 #include "component_custom.h"
@@ -8,6 +13,8 @@
 #include "system_mesh_render.h"
 #include "system_collisions.h"
 #include "system_custom_behaviour.h"
+#include "job_system.h"
+#include "log.h"
 
 namespace engine {
 
@@ -20,10 +27,22 @@ Scene::Scene(Application* app) : app_(app)
 
     RegisterComponent<TransformComponent>();
     RegisterComponent<ColliderComponent>();
-    RegisterComponent<CustomComponent>();
+    RegisterComponent<CustomComponent>(ComponentStorage::SPARSE_SET);
     RegisterComponent<MeshRenderableComponent>();
 
-    // Order here matters:
+    // entities start off in the archetype with no components
+    archetypes_.emplace_back(std::make_unique<Archetype>(Signature{}, component_infos_));
+    archetype_indices_.emplace(Signature{}, 0);
+    // entity index 0 is never used
+    entity_locations_.emplace_back();
+    signatures_.emplace_back();
+    hierarchy_.emplace_back();
+    // value-initialised transforms get the empty tag
+    InternTag("");
+
+    SetJobSystem(app ? app->getJobSystem() : nullptr);
+
+    // Registration order decides the order of systems that conflict (see System::conflicts())
     RegisterSystem<CustomBehaviourSystem>(); // potentially modifies transforms
     RegisterSystem<TransformSystem>();
     RegisterSystem<CollisionSystem>();  // depends on transformed world matrix
@@ -34,32 +53,713 @@ Scene::~Scene() {}
 
 Entity Scene::CreateEntity(const std::string& tag, Entity parent, const glm::vec3& pos, const glm::quat& rot, const glm::vec3& scl)
 {
-    Entity id = next_entity_id_++;
+    Signature signature{};
+    signature.set(getComponentTypeId<TransformComponent>());
 
-    signatures_.emplace(id, std::bitset<MAX_COMPONENTS>{});
+    Entity id;
+    AllocateEntities(1, signature, &id);
 
-    auto t = AddComponent<TransformComponent>(id);
+    auto t = ConstructComponent<TransformComponent>(id);
 
     t->position = pos;
     t->rotation = rot;
     t->scale = scl;
 
-    t->tag = tag;
+    t->tag_id = InternTag(tag);
     t->parent = parent;
     t->is_static = false;
 
+    FinishCreatingEntities(&id, 1, parent, signature);
+
     return id;
 }
 
-/* returns 0 if entity not found */
-Entity Scene::GetEntity(const std::string& tag, Entity parent) { return GetSystem<TransformSystem>()->GetChildEntity(parent, tag); }
+void Scene::AllocateEntities(size_t count, const Signature& signature, Entity* entities)
+{
+    // recycled indices first, then new ones
+    const size_t recycled = std::min(count, free_entity_indices_.size());
+    const size_t first_new_index = entity_locations_.size();
+    if (first_new_index + (count - recycled) - 1 > ENTITY_INDEX_MASK) {
+        throw std::runtime_error("Too many entities!");
+    }
+    entity_locations_.resize(first_new_index + (count - recycled), EntityLocation{.archetype = 0, .row = 0, .generation = 0});
+    signatures_.resize(entity_locations_.size());
+    hierarchy_.resize(entity_locations_.size());
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t index;
+        if (i < recycled) {
+            index = free_entity_indices_.back();
+            free_entity_indices_.pop_back();
+        }
+        else {
+            index = static_cast<uint32_t>(first_new_index + (i - recycled));
+        }
+        entities[i] = makeEntity(index, entity_locations_[index].generation);
+        signatures_[index] = signature;
+        hierarchy_[index] = HierarchyNode{};
+    }
+
+    // every entity goes straight into its final archetype
+    const uint32_t archetype_index = GetArchetypeIndex(signature & archetype_mask_);
+    const size_t first_row = archetypes_[archetype_index]->allocateRows(entities, count);
+    for (size_t i = 0; i < count; ++i) {
+        EntityLocation& location = entity_locations_[entityIndex(entities[i])];
+        location.archetype = archetype_index;
+        location.row = static_cast<uint32_t>(first_row + i);
+    }
+}
+
+void Scene::FinishCreatingEntities(const Entity* entities, size_t count, Entity parent, const Signature& signature)
+{
+    assert((parent == 0 || IsEntityValid(parent)) && "Creating an entity under a destroyed parent.");
+    for (size_t i = 0; i < count; ++i) {
+        LinkToParent(entities[i], parent);
+        IndexEntityName(entities[i], parent, ReadComponent<TransformComponent>(entities[i])->tag_id);
+    }
+    AddNewEntitiesToSystems(entities, count, signature);
+}
+
+void Scene::AddNewEntitiesToSystems(const Entity* entities, size_t count, const Signature& signature)
+{
+    for (auto& [system_id, system] : ecs_systems_) {
+        if (system->m_signature.isSubsetOf(signature) == false) continue;
+        system->m_entities.insert(entities, count);
+        for (size_t i = 0; i < count; ++i) {
+            system->onComponentInsert(entities[i]);
+        }
+    }
+}
+
+Entity Scene::GetEntity(const std::string& tag, Entity parent)
+{
+    auto tag_it = tag_ids_.find(tag);
+    if (tag_it == tag_ids_.end()) return 0;
+    auto it = entity_names_.find(EntityNameKey(parent, tag_it->second));
+    return (it != entity_names_.end()) ? it->second : 0;
+}
+
+Prefab Scene::CreatePrefab(Entity root)
+{
+    assert(IsEntityValid(root) && "Making a prefab of a destroyed entity.");
+
+    // hierarchy order, so that each node's parent comes before it
+    std::vector<Entity> entities{root};
+    ForEachDescendant(root, [&entities](Entity entity) { entities.push_back(entity); });
+    std::vector<uint32_t> node_indices(entity_locations_.size(), 0); // indexed by entity index
+    for (uint32_t i = 0; i < entities.size(); ++i) {
+        node_indices[entityIndex(entities[i])] = i;
+    }
+
+    Prefab prefab{};
+    prefab.m_nodes.reserve(entities.size());
+    for (Entity entity : entities) {
+        const TransformComponent* t = ReadComponent<TransformComponent>(entity);
+        const uint32_t parent = (entity == root) ? 0 : node_indices[entityIndex(t->parent)];
+        prefab.m_nodes.push_back(Prefab::Node{tag_names_[t->tag_id], parent, t->position, t->rotation, t->scale, t->is_static});
+    }
+
+    const size_t transform_position = getComponentTypeId<TransformComponent>();
+    registered_components_.forEachSetBit([&](size_t position) {
+        if (position == transform_position) return;
+        Prefab::Column column{};
+        for (uint32_t i = 0; i < entities.size(); ++i) {
+            if (signatures_[entityIndex(entities[i])].test(position)) column.nodes.push_back(i);
+        }
+        if (column.nodes.empty()) return;
+
+        const ComponentTypeInfo& info = component_infos_[position];
+        if (info.copy == nullptr) {
+            LOG_WARN("Component type {} isn't copy constructible and is left out of the prefab", position);
+            return;
+        }
+        column.position = position;
+        column.info = info;
+        // new[] only guarantees the default alignment, so over-allocate and align the pointer itself
+        column.allocation = std::make_unique<std::byte[]>(column.nodes.size() * info.size + info.alignment);
+        const uintptr_t base = reinterpret_cast<uintptr_t>(column.allocation.get());
+        column.data = column.allocation.get() + ((base + info.alignment - 1) / info.alignment * info.alignment - base);
+        for (size_t i = 0; i < column.nodes.size(); ++i) {
+            info.copy(column.data + i * info.size, GetComponentAtPosition(entities[column.nodes[i]], position));
+        }
+        prefab.m_columns.push_back(std::move(column));
+    });
+
+    // nodes are grouped by signature, so that Instantiate() can allocate each group in its archetype at once
+    std::vector<Signature> node_signatures(entities.size());
+    for (Signature& signature : node_signatures) {
+        signature.set(transform_position);
+    }
+    for (const Prefab::Column& column : prefab.m_columns) {
+        for (uint32_t node : column.nodes) {
+            node_signatures[node].set(column.position);
+        }
+    }
+    std::unordered_map<Signature, size_t> group_indices{};
+    for (uint32_t i = 0; i < entities.size(); ++i) {
+        auto [it, inserted] = group_indices.emplace(node_signatures[i], prefab.m_groups.size());
+        if (inserted) {
+            prefab.m_groups.push_back(Prefab::Group{node_signatures[i], {}});
+        }
+        prefab.m_groups[it->second].nodes.push_back(i);
+    }
+
+    return prefab;
+}
+
+Entity Scene::Instantiate(const Prefab& prefab, Entity parent, const glm::vec3& pos, const glm::quat& rot, const glm::vec3& scl)
+{
+    assert(prefab.m_nodes.empty() == false && "Instantiating an empty prefab.");
+    assert((parent == 0 || IsEntityValid(parent)) && "Instantiating a prefab under a destroyed parent.");
+
+    // each group of nodes goes straight into its final archetype
+    std::vector<Entity> created(prefab.m_nodes.size(), 0);
+    std::vector<Entity> group_entities{};
+    for (const Prefab::Group& group : prefab.m_groups) {
+        assert(group.signature.isSubsetOf(registered_components_) && "Instantiating a prefab with a component type that isn't registered.");
+        group_entities.resize(group.nodes.size());
+        AllocateEntities(group.nodes.size(), group.signature, group_entities.data());
+        for (size_t i = 0; i < group.nodes.size(); ++i) {
+            created[group.nodes[i]] = group_entities[i];
+        }
+    }
+
+    for (uint32_t i = 0; i < prefab.m_nodes.size(); ++i) {
+        const Prefab::Node& node = prefab.m_nodes[i];
+        TransformComponent* t = ConstructComponent<TransformComponent>(created[i]);
+        if (i == 0) {
+            t->position = pos;
+            t->rotation = rot;
+            t->scale = scl;
+            t->parent = parent;
+        }
+        else {
+            t->position = node.position;
+            t->rotation = node.rotation;
+            t->scale = node.scale;
+            t->parent = created[node.parent];
+        }
+        t->tag_id = InternTag(node.tag);
+        t->is_static = node.is_static;
+    }
+
+    // copy-construct each column straight into the new entities' storage
+    for (const Prefab::Column& column : prefab.m_columns) {
+        const size_t position = column.position;
+        const ComponentTypeInfo& info = component_infos_[position];
+        for (size_t i = 0; i < column.nodes.size(); ++i) {
+            const Entity entity = created[column.nodes[i]];
+            std::byte* source = column.data + i * info.size;
+            if (sparse_sets_[position]) {
+                sparse_sets_[position]->insertCopy(entity, source);
+                *sparse_sets_[position]->getTicks(entity) = ComponentTicks{change_tick_, change_tick_};
+                continue;
+            }
+            const EntityLocation& location = entity_locations_[entityIndex(entity)];
+            Archetype* archetype = archetypes_[location.archetype].get();
+            void* component_memory = archetype->getComponent(location.row, position);
+            if (info.trivially_copyable) {
+                memcpy(component_memory, source, info.size);
+            }
+            else {
+                info.copy(component_memory, source);
+            }
+            *archetype->getTicks(location.row, position) = ComponentTicks{change_tick_, change_tick_};
+        }
+    }
+
+    // nodes are in hierarchy order, so each parent is linked before its children
+    for (uint32_t i = 0; i < prefab.m_nodes.size(); ++i) {
+        const Entity entity = created[i];
+        const TransformComponent* t = ReadComponent<TransformComponent>(entity);
+        LinkToParent(entity, t->parent);
+        IndexEntityName(entity, t->parent, t->tag_id);
+    }
+
+    // systems only see the instance once all of it exists
+    for (const Prefab::Group& group : prefab.m_groups) {
+        group_entities.resize(group.nodes.size());
+        for (size_t i = 0; i < group.nodes.size(); ++i) {
+            group_entities[i] = created[group.nodes[i]];
+        }
+        AddNewEntitiesToSystems(group_entities.data(), group_entities.size(), group.signature);
+    }
+
+    return created[0];
+}
+
+void Scene::SetEntityTag(Entity entity, const std::string& tag)
+{
+    TransformComponent* t = GetTransform(entity);
+    UnindexEntityName(entity, t->parent, t->tag_id);
+    t->tag_id = InternTag(tag);
+    IndexEntityName(entity, t->parent, t->tag_id);
+}
+
+void Scene::SetEntityParent(Entity entity, Entity parent)
+{
+    assert(parent != entity && "Parenting an entity to itself.");
+    assert((parent == 0 || IsEntityValid(parent)) && "Parenting an entity to a destroyed entity.");
+#ifndef NDEBUG
+    for (Entity ancestor = parent; ancestor != 0; ancestor = GetEntityParent(ancestor)) {
+        assert(ancestor != entity && "Parenting an entity to one of its descendants.");
+    }
+#endif
+
+    TransformComponent* t = GetTransform(entity); // marks the transform as changed so its world matrix is rebuilt
+    UnindexEntityName(entity, t->parent, t->tag_id);
+    t->parent = parent;
+    IndexEntityName(entity, t->parent, t->tag_id);
+
+    ++reparent_version_;
+    UnlinkFromParent(entity);
+    LinkToParent(entity, parent);
+    ForEachDescendant(entity, [this](Entity descendant) {
+        HierarchyNode& node = hierarchy_[entityIndex(descendant)];
+        node.depth = hierarchy_[entityIndex(node.parent)].depth + 1;
+    });
+}
+
+void Scene::LinkToParent(Entity entity, Entity parent)
+{
+    HierarchyNode& node = hierarchy_[entityIndex(entity)];
+    HierarchyNode& parent_node = hierarchy_[entityIndex(parent)];
+    node.parent = parent;
+    node.prev_sibling = parent_node.last_child;
+    node.next_sibling = 0;
+    node.depth = (parent == 0) ? 0 : parent_node.depth + 1;
+    if (parent_node.last_child != 0) {
+        hierarchy_[entityIndex(parent_node.last_child)].next_sibling = entity;
+    }
+    else {
+        parent_node.first_child = entity;
+    }
+    parent_node.last_child = entity;
+}
+
+void Scene::UnlinkFromParent(Entity entity)
+{
+    HierarchyNode& node = hierarchy_[entityIndex(entity)];
+    HierarchyNode& parent_node = hierarchy_[entityIndex(node.parent)];
+    if (node.prev_sibling != 0) {
+        hierarchy_[entityIndex(node.prev_sibling)].next_sibling = node.next_sibling;
+    }
+    else {
+        parent_node.first_child = node.next_sibling;
+    }
+    if (node.next_sibling != 0) {
+        hierarchy_[entityIndex(node.next_sibling)].prev_sibling = node.prev_sibling;
+    }
+    else {
+        parent_node.last_child = node.prev_sibling;
+    }
+    node.parent = 0;
+    node.prev_sibling = 0;
+    node.next_sibling = 0;
+}
+
+uint32_t Scene::InternTag(const std::string& tag)
+{
+    const auto [tag_it, inserted] = tag_ids_.try_emplace(tag, static_cast<uint32_t>(tag_names_.size()));
+    if (inserted) tag_names_.push_back(tag);
+    return tag_it->second;
+}
 
-size_t Scene::GetComponentSignaturePosition(size_t hash) { return component_signature_positions_.at(hash); }
+void Scene::IndexEntityName(Entity entity, Entity parent, uint32_t tag_id) { entity_names_.emplace(EntityNameKey(parent, tag_id), entity); }
+
+void Scene::UnindexEntityName(Entity entity, Entity parent, uint32_t tag_id)
+{
+    auto [begin, end] = entity_names_.equal_range(EntityNameKey(parent, tag_id));
+    for (auto it = begin; it != end; ++it) {
+        if (it->second == entity) {
+            entity_names_.erase(it);
+            return;
+        }
+    }
+    assert(false && "Entity is missing from the name index.");
+}
+
+void Scene::DestroyEntity(Entity entity)
+{
+    assert(IsEntityValid(entity) && "Destroying an entity that doesn't exist.");
+
+    // children go first, each one unlinks itself
+    const uint32_t index = entityIndex(entity);
+    while (hierarchy_[index].first_child != 0) {
+        DestroyEntity(hierarchy_[index].first_child);
+    }
+    UnlinkFromParent(entity);
+
+    // systems are notified while the components still exist
+    for (auto& [system_id, system] : ecs_systems_) {
+        if (system->m_entities.contains(entity)) {
+            system->onComponentRemove(entity);
+            system->m_entities.erase(entity);
+        }
+    }
+
+    const TransformComponent* t = ReadComponent<TransformComponent>(entity);
+    UnindexEntityName(entity, t->parent, t->tag_id);
+
+    signatures_[index].forEachSetBit([&](size_t position) {
+        if (sparse_sets_[position]) {
+            sparse_sets_[position]->remove(entity);
+        }
+    });
+    signatures_[index] = Signature{};
+
+    EntityLocation& location = entity_locations_[index];
+    const Entity moved_entity = archetypes_[location.archetype]->removeRow(location.row);
+    if (moved_entity != 0) {
+        entity_locations_[entityIndex(moved_entity)].row = location.row;
+    }
+    // invalidates existing handles to this entity
+    location.generation = (location.generation + 1) & ENTITY_GENERATION_MASK;
+    free_entity_indices_.push_back(index);
+}
+
+uint32_t Scene::GetArchetypeIndex(const Signature& signature)
+{
+    auto it = archetype_indices_.find(signature);
+    if (it != archetype_indices_.end()) {
+        return it->second;
+    }
+    const uint32_t index = static_cast<uint32_t>(archetypes_.size());
+    archetypes_.emplace_back(std::make_unique<Archetype>(signature, component_infos_));
+    archetype_indices_.emplace(signature, index);
+    return index;
+}
+
+const Scene::EntityLocation& Scene::MoveEntityToArchetype(Entity entity, uint32_t archetype_index)
+{
+    EntityLocation& location = entity_locations_[entityIndex(entity)];
+    if (location.archetype != archetype_index) {
+        const auto [new_row, moved_entity] = archetypes_[location.archetype]->moveRow(location.row, *archetypes_[archetype_index]);
+        if (moved_entity != 0) {
+            // the last entity in the old archetype has filled the gap
+            entity_locations_[entityIndex(moved_entity)].row = location.row;
+        }
+        location.archetype = archetype_index;
+        location.row = static_cast<uint32_t>(new_row);
+    }
+    return location;
+}
+
+void Scene::RemoveComponentAtPosition(Entity entity, size_t signature_position)
+{
+    assert(IsEntityValid(entity) && "Removing component from a destroyed entity.");
+    Signature& signature_ref = signatures_[entityIndex(entity)];
+    assert(signature_ref.test(signature_position) && "Removing component that the entity doesn't have.");
+    signature_ref.reset(signature_position);
+
+    // systems are notified while the component still exists
+    for (auto& [system_id, system] : ecs_systems_) {
+        if (system->m_entities.contains(entity) == false) continue;
+        if (system->m_signature.isSubsetOf(signature_ref) == false) {
+            system->onComponentRemove(entity);
+            system->m_entities.erase(entity);
+        }
+    }
+
+    if (sparse_sets_[signature_position]) {
+        sparse_sets_[signature_position]->remove(entity);
+    }
+    else {
+        // the removed component is destroyed as the entity moves
+        MoveEntityToArchetype(entity, GetArchetypeIndex(signature_ref & archetype_mask_));
+    }
+}
+
+void* Scene::GetComponentAtPosition(Entity entity, size_t signature_position)
+{
+    if (sparse_sets_[signature_position]) {
+        return sparse_sets_[signature_position]->getComponent(entity);
+    }
+    const EntityLocation& location = entity_locations_[entityIndex(entity)];
+    return archetypes_[location.archetype]->getComponent(location.row, signature_position);
+}
+
+void Scene::AddComponentsAtPositions(Entity entity, const std::vector<ComponentSource>& components, bool copy)
+{
+    assert(IsEntityValid(entity) && "Adding components to a destroyed entity.");
+    Signature& signature_ref = signatures_[entityIndex(entity)];
+    for (const ComponentSource& component : components) {
+        assert(registered_components_.test(component.position) && "Adding component type that isn't registered.");
+        assert(signature_ref.test(component.position) == false && "Adding component to entity that already has it.");
+        signature_ref.set(component.position);
+    }
+
+    const EntityLocation& location = MoveEntityToArchetype(entity, GetArchetypeIndex(signature_ref & archetype_mask_));
+    for (const ComponentSource& component : components) {
+        const size_t position = component.position;
+        const ComponentTypeInfo& info = component_infos_[position];
+        if (sparse_sets_[position]) {
+            if (copy) {
+                sparse_sets_[position]->insertCopy(entity, component.data);
+            }
+            else {
+                sparse_sets_[position]->insertRelocate(entity, component.data);
+            }
+            *sparse_sets_[position]->getTicks(entity) = ComponentTicks{change_tick_, change_tick_};
+        }
+        else {
+            void* component_memory = archetypes_[location.archetype]->getComponent(location.row, position);
+            if (info.trivially_copyable) {
+                memcpy(component_memory, component.data, info.size);
+            }
+            else if (copy) {
+                assert(info.copy != nullptr && "Copying a component type that isn't copy constructible.");
+                info.copy(component_memory, component.data);
+            }
+            else {
+                info.relocate(component_memory, component.data);
+            }
+            *archetypes_[location.archetype]->getTicks(location.row, position) = ComponentTicks{change_tick_, change_tick_};
+        }
+    }
+
+    for (auto& [system_id, system] : ecs_systems_) {
+        if (system->m_entities.contains(entity)) continue;
+        if (system->m_signature.isSubsetOf(signature_ref)) {
+            system->m_entities.insert(entity);
+            system->onComponentInsert(entity);
+        }
+    }
+}
+
+EntityCommandBuffer& Scene::GetCommandBuffer()
+{
+    const unsigned int thread_index = JobSystem::getThreadIndex();
+    return *command_buffers_[(thread_index < command_buffers_.size()) ? thread_index : 0];
+}
+
+void Scene::PlaybackCommands(EntityCommandBuffer& commands)
+{
+    using Command = EntityCommandBuffer::Command;
+    using EntityRef = EntityCommandBuffer::EntityRef;
+
+    if (commands.empty()) return;
+
+    // take the commands, as systems may record more while being notified of these
+    std::vector<EntityCommandBuffer::CreateCommand> creates = std::move(commands.m_creates);
+    std::vector<Command> command_list = std::move(commands.m_commands);
+    commands.m_creates.clear();
+    commands.m_commands.clear();
+
+    // entities are created first so that the other commands can refer to them
+    std::vector<Entity> created(creates.size(), 0);
+    auto resolve = [&created](const EntityRef& ref) -> Entity { return (ref.pending == EntityRef::NOT_PENDING) ? ref.entity : created[ref.pending]; };
+    for (size_t i = 0; i < creates.size(); ++i) {
+        const EntityCommandBuffer::CreateCommand& create = creates[i];
+        created[i] = CreateEntity(create.tag, resolve(create.parent), create.pos, create.rot, create.scl);
+    }
+
+    // sort by entity index, keeping the recorded order of each entity's commands
+    struct SortedCommand {
+        uint32_t entity_index;
+        Entity entity;
+        Command* command;
+    };
+    std::vector<SortedCommand> sorted{};
+    sorted.reserve(command_list.size());
+    for (Command& command : command_list) {
+        const Entity entity = resolve(command.entity);
+        sorted.push_back(SortedCommand{entityIndex(entity), entity, &command});
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const SortedCommand& a, const SortedCommand& b) {
+        return (a.entity_index != b.entity_index) ? (a.entity_index < b.entity_index) : (a.entity < b.entity);
+    });
+
+    std::vector<Command*> entity_commands{};
+    for (size_t begin = 0; begin < sorted.size();) {
+        size_t end = begin;
+        entity_commands.clear();
+        while (end < sorted.size() && sorted[end].entity == sorted[begin].entity) {
+            entity_commands.push_back(sorted[end].command);
+            ++end;
+        }
+        PlaybackEntityCommands(sorted[begin].entity, entity_commands);
+        begin = end;
+    }
+
+    EntityCommandBuffer::destroyComponents(command_list);
+    if (commands.empty()) {
+        // nothing refers to the buffer's component memory anymore. Keep the allocations for next time.
+        commands.m_creates = std::move(creates);
+        commands.m_commands = std::move(command_list);
+        commands.clear();
+    }
+}
+
+void Scene::PlaybackEntityCommands(Entity entity, const std::vector<EntityCommandBuffer::Command*>& commands)
+{
+    using Command = EntityCommandBuffer::Command;
+    using CommandType = EntityCommandBuffer::CommandType;
+
+    // the entity may have been destroyed by an earlier command, for example along with its parent
+    if (IsEntityValid(entity) == false) return;
+
+    for (const Command* command : commands) {
+        if (command->type == CommandType::DESTROY_ENTITY) {
+            DestroyEntity(entity);
+            return;
+        }
+    }
+
+    // work out the final set of components first, so the entity only changes archetype once
+    const uint32_t index = entityIndex(entity);
+    const Signature old_signature = signatures_[index];
+    Signature signature = old_signature;
+    Signature replaced{}; // components removed and then added again
+    std::vector<Command*> added{};
+    for (Command* command : commands) {
+        const size_t position = command->component_id;
+        if (command->type == CommandType::ADD_COMPONENT) {
+            assert(registered_components_.test(position) && "Adding component type that isn't registered.");
+            assert(signature.test(position) == false && "Adding component to entity that already has it.");
+            signature.set(position);
+            if (old_signature.test(position)) replaced.set(position);
+            added.push_back(command);
+        }
+        else {
+            assert(signature.test(position) && "Removing component that the entity doesn't have.");
+            signature.reset(position);
+            replaced.reset(position);
+            std::erase_if(added, [position](const Command* add) { return add->component_id == position; });
+        }
+    }
+
+    // systems are notified while the removed components still exist
+    for (auto& [system_id, system] : ecs_systems_) {
+        if (system->m_entities.contains(entity) == false) continue;
+        if (system->m_signature.isSubsetOf(signature) == false || (system->m_signature & replaced).none() == false) {
+            system->onComponentRemove(entity);
+            system->m_entities.erase(entity);
+        }
+    }
+
+    old_signature.forEachSetBit([&](size_t position) {
+        if (sparse_sets_[position] && (signature.test(position) == false || replaced.test(position))) {
+            sparse_sets_[position]->remove(entity);
+        }
+    });
+    signatures_[index] = signature;
+
+    // components removed from archetype storage are destroyed as the entity moves
+    const EntityLocation& location = MoveEntityToArchetype(entity, GetArchetypeIndex(signature & archetype_mask_));
+    for (Command* command : added) {
+        const size_t position = command->component_id;
+        if (sparse_sets_[position]) {
+            sparse_sets_[position]->insertRelocate(entity, command->data);
+            *sparse_sets_[position]->getTicks(entity) = ComponentTicks{change_tick_, change_tick_};
+        }
+        else {
+            void* component_memory = archetypes_[location.archetype]->getComponent(location.row, position);
+            if (replaced.test(position)) {
+                component_infos_[position].destroy(component_memory);
+            }
+            command->info->relocate(component_memory, command->data);
+            *archetypes_[location.archetype]->getTicks(location.row, position) = ComponentTicks{change_tick_, change_tick_};
+        }
+        command->data = nullptr;
+    }
+
+    for (auto& [system_id, system] : ecs_systems_) {
+        if (system->m_entities.contains(entity)) continue;
+        if (system->m_signature.isSubsetOf(signature)) {
+            system->m_entities.insert(entity);
+            system->onComponentInsert(entity);
+        }
+    }
+}
+
+void Scene::PlaybackCommandBuffers()
+{
+    // playing back may record more commands, so repeat until every buffer is empty
+    bool played = true;
+    while (played) {
+        played = false;
+        for (std::unique_ptr<EntityCommandBuffer>& buffer : command_buffers_) {
+            if (buffer->empty()) continue;
+            PlaybackCommands(*buffer);
+            played = true;
+        }
+    }
+}
+
+void Scene::SetJobSystem(JobSystem* job_system)
+{
+    job_system_ = job_system;
+    // one command buffer per thread
+    const unsigned int thread_count = job_system_ ? job_system_->getThreadCount() : 1;
+    command_buffers_.resize(thread_count);
+    for (std::unique_ptr<EntityCommandBuffer>& buffer : command_buffers_) {
+        if (buffer == nullptr) buffer = std::make_unique<EntityCommandBuffer>();
+    }
+}
+
+void Scene::BuildSystemStages()
+{
+    // A system depends on every earlier system it conflicts with, so it goes in the stage after the latest of those.
+    std::vector<size_t> system_stage(ecs_systems_.size(), 0);
+    system_stages_.clear();
+    for (size_t i = 0; i < ecs_systems_.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            if (System::conflicts(*ecs_systems_[i].second, *ecs_systems_[j].second)) {
+                system_stage[i] = std::max(system_stage[i], system_stage[j] + 1);
+            }
+        }
+        if (system_stage[i] >= system_stages_.size()) system_stages_.resize(system_stage[i] + 1);
+        system_stages_[system_stage[i]].push_back(ecs_systems_[i].second.get());
+    }
+    system_stages_dirty_ = false;
+    LOG_DEBUG("Scheduled {} systems into {} stages", ecs_systems_.size(), system_stages_.size());
+}
 
 void Scene::Update(float ts)
 {
-    for (auto& [name, system] : ecs_systems_) {
-        system->onUpdate(ts);
+    if (fixed_timestep_ <= 0.0f) {
+        Step(ts);
+        return;
+    }
+
+    step_accumulator_ += ts;
+    uint32_t steps = 0;
+    while (step_accumulator_ >= fixed_timestep_) {
+        if (steps == max_steps_per_frame_) {
+            // the simulation can't keep up, so drop the time instead of spending ever longer catching up
+            step_accumulator_ = std::fmod(step_accumulator_, fixed_timestep_);
+            break;
+        }
+        Step(fixed_timestep_);
+        step_accumulator_ -= fixed_timestep_;
+        ++steps;
+    }
+}
+
+void Scene::Step(float ts)
+{
+    if (system_stages_dirty_) BuildSystemStages();
+
+    for (const std::vector<System*>& stage : system_stages_) {
+        if (job_system_ == nullptr || stage.size() == 1) {
+            for (System* system : stage) {
+                system->onUpdate(ts);
+            }
+        }
+        else {
+            JobCounter stage_counter{};
+            for (System* system : stage) {
+                job_system_->run([system, ts]() { system->onUpdate(ts); }, &stage_counter);
+            }
+            job_system_->wait(stage_counter); // rethrows exceptions from the systems
+        }
+        for (System* system : stage) {
+            system->m_last_run_tick = change_tick_;
+        }
+        // later writes, including the stage's own structural changes, are newer than anything the stage has seen
+        ++change_tick_;
+        // sync point for structural changes recorded by the stage
+        PlaybackCommandBuffers();
     }
 
     event_system_->despatchEvents(); // clears event queue
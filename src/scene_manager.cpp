@@ -1,10 +1,14 @@
 #include "scene_manager.h"
 
+#include "application.h"
+#include "job_system.h"
 #include "scene.h"
 #include "resource_texture.h"
 
 #include <assert.h>
 
+#include <algorithm>
+
 namespace engine {
 
 SceneManager::SceneManager(Application* app) : app_(app) {}
@@ -18,17 +22,73 @@ Scene* SceneManager::CreateEmptyScene()
     return scenes_.back().get();
 }
 
+ScenePreload SceneManager::PreloadSceneAsync(std::function<void(Scene&)> builder)
+{
+    ScenePreload preload{};
+    // a thread of its own rather than a job, as jobs are picked up by threads waiting on the job system, such as the one running the game loop
+    preload.future_ = std::async(std::launch::async, [app = app_, builder = std::move(builder)]() {
+        auto scene = std::make_unique<Scene>(app);
+        scene->SetJobSystem(nullptr); // keeps the builder's work, such as glTF loading, on this thread rather than the game loop's job threads
+        builder(*scene);
+        return scene;
+    });
+    return preload;
+}
+
+Scene* SceneManager::TakePreloadedScene(ScenePreload& preload)
+{
+    if (preload.IsReady() == false) return nullptr;
+    std::unique_ptr<Scene> scene = preload.future_.get();
+    scene->SetJobSystem(app_ ? app_->getJobSystem() : nullptr);
+    scenes_.emplace_back(std::move(scene));
+    return scenes_.back().get();
+}
+
+void SceneManager::SetSceneLive(Scene* scene, bool live)
+{
+    assert(std::find_if(scenes_.begin(), scenes_.end(), [scene](const auto& unique_scene) { return unique_scene.get() == scene; }) != scenes_.end());
+    if (live == IsSceneLive(scene)) return;
+    if (live) {
+        live_scenes_.push_back(scene);
+    }
+    else {
+        live_scenes_.erase(std::find(live_scenes_.begin(), live_scenes_.end(), scene));
+    }
+}
+
 Scene* SceneManager::UpdateActiveScene(float ts)
 {
+    Scene* activeScene = nullptr;
     if (active_scene_index_ >= 0) [[likely]] {
         assert((size_t)active_scene_index_ < scenes_.size());
-        Scene* activeScene = scenes_[active_scene_index_].get();
-        activeScene->Update(ts);
-        return activeScene;
+        activeScene = scenes_[active_scene_index_].get();
     }
-    else {
-        return nullptr;
+
+    // scenes share no state, so background scenes are updated as jobs while this thread updates the active scene
+    JobSystem* const job_system = app_ ? app_->getJobSystem() : nullptr;
+    JobCounter background_counter{};
+    for (Scene* scene : live_scenes_) {
+        if (scene == activeScene) continue;
+        if (job_system) {
+            job_system->run([scene, ts]() { scene->Update(ts); }, &background_counter);
+        }
+        else {
+            scene->Update(ts);
+        }
     }
+
+    if (activeScene) {
+        try {
+            activeScene->Update(ts);
+        }
+        catch (...) {
+            if (job_system) job_system->wait(background_counter); // the background updates still reference their scenes
+            throw;
+        }
+    }
+    if (job_system) job_system->wait(background_counter); // rethrows exceptions from background scenes
+
+    return activeScene;
 }
 
 } // namespace engine
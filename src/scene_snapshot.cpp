@@ -0,0 +1,315 @@
+#include "scene_snapshot.h"
+
+#include <cstring>
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "component_mesh.h"
+#include "component_transform.h"
+#include "files.h"
+#include "log.h"
+#include "resource_material.h"
+#include "resource_mesh.h"
+#include "scene.h"
+
+namespace engine {
+
+static uint64_t alignUp(uint64_t offset, uint64_t alignment) { return (offset + alignment - 1) / alignment * alignment; }
+
+void SnapshotResources::add(const std::shared_ptr<Mesh>& mesh) { meshes.emplace(mesh->getContentHash(), mesh); }
+
+void SnapshotResources::add(const std::shared_ptr<Material>& material) { materials.emplace(material->getContentHash(), material); }
+
+void Scene::SaveSnapshot(const std::string& path)
+{
+    const size_t transform_position = getComponentTypeId<TransformComponent>();
+    const size_t renderable_position = getComponentTypeId<MeshRenderableComponent>();
+
+    // hierarchy order means parents are always created before their children on load
+    std::vector<Entity> entities{};
+    ForEachDescendant(0, [&entities](Entity entity) { entities.push_back(entity); });
+    std::vector<uint32_t> snapshot_indices(entity_locations_.size(), 0); // indexed by entity index
+    for (uint32_t i = 0; i < entities.size(); ++i) {
+        snapshot_indices[entityIndex(entities[i])] = i;
+    }
+
+    std::vector<SnapshotEntity> snapshot_entities{};
+    snapshot_entities.reserve(entities.size());
+    std::string strings{};
+    std::vector<SnapshotMeshRenderable> renderables{};
+    for (uint32_t i = 0; i < entities.size(); ++i) {
+        const TransformComponent* t = ReadComponent<TransformComponent>(entities[i]);
+        const std::string& tag = tag_names_[t->tag_id];
+        snapshot_entities.push_back(SnapshotEntity{.world_matrix = t->world_matrix,
+                                                   .rotation = t->rotation,
+                                                   .position = t->position,
+                                                   .scale = t->scale,
+                                                   .parent = (t->parent == 0) ? 0 : snapshot_indices[entityIndex(t->parent)] + 1,
+                                                   .tag_offset = static_cast<uint32_t>(strings.size()),
+                                                   .tag_size = static_cast<uint32_t>(tag.size()),
+                                                   .is_static = t->is_static});
+        strings += tag;
+
+        if (const MeshRenderableComponent* renderable = ReadComponent<MeshRenderableComponent>(entities[i])) {
+            renderables.push_back(SnapshotMeshRenderable{.entity = i,
+                                                         .visible = renderable->visible,
+                                                         .mesh_hash = renderable->mesh->getContentHash(),
+                                                         .material_hash = renderable->material->getContentHash()});
+        }
+    }
+
+    // every trivially copyable component type is saved as one column
+    struct Column {
+        SnapshotColumn header;
+        std::vector<uint32_t> entities;
+        std::vector<std::byte> data;
+    };
+    std::vector<Column> columns{};
+    registered_components_.forEachSetBit([&](size_t position) {
+        const ComponentTypeInfo& info = component_infos_[position];
+        if (position == transform_position || position == renderable_position) return;
+        if (info.trivially_copyable == false) {
+            LOG_DEBUG("Component type {} isn't trivially copyable and won't be saved to the snapshot", position);
+            return;
+        }
+        if (info.alignment > SNAPSHOT_ALIGNMENT) {
+            LOG_WARN("Component type {} is aligned to more than {} bytes and won't be saved to the snapshot", position, SNAPSHOT_ALIGNMENT);
+            return;
+        }
+        Column column{};
+        for (uint32_t i = 0; i < entities.size(); ++i) {
+            if (signatures_[entityIndex(entities[i])].test(position) == false) continue;
+            const std::byte* component = static_cast<const std::byte*>(GetComponentAtPosition(entities[i], position));
+            column.entities.push_back(i);
+            column.data.insert(column.data.end(), component, component + info.size);
+        }
+        if (column.entities.empty()) return;
+        column.header.type_hash = info.name_hash;
+        column.header.component_size = info.size;
+        column.header.count = column.entities.size();
+        columns.push_back(std::move(column));
+    });
+
+    // lay out the sections
+    SnapshotHeader header{};
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.layout_hash = snapshotLayoutHash();
+    header.entity_count = static_cast<uint32_t>(snapshot_entities.size());
+    header.mesh_renderable_count = static_cast<uint32_t>(renderables.size());
+    header.column_count = static_cast<uint32_t>(columns.size());
+    uint64_t offset = alignUp(sizeof(SnapshotHeader), SNAPSHOT_ALIGNMENT);
+    header.entities_offset = offset;
+    offset = alignUp(offset + snapshot_entities.size() * sizeof(SnapshotEntity), SNAPSHOT_ALIGNMENT);
+    header.strings_offset = offset;
+    header.strings_size = strings.size();
+    offset = alignUp(offset + strings.size(), SNAPSHOT_ALIGNMENT);
+    header.mesh_renderables_offset = offset;
+    offset = alignUp(offset + renderables.size() * sizeof(SnapshotMeshRenderable), SNAPSHOT_ALIGNMENT);
+    header.columns_offset = offset;
+    offset = alignUp(offset + columns.size() * sizeof(SnapshotColumn), SNAPSHOT_ALIGNMENT);
+    for (Column& column : columns) {
+        column.header.entities_offset = offset;
+        offset = alignUp(offset + column.entities.size() * sizeof(uint32_t), SNAPSHOT_ALIGNMENT);
+        column.header.data_offset = offset;
+        offset = alignUp(offset + column.data.size(), SNAPSHOT_ALIGNMENT);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (file.is_open() == false) {
+        throw std::runtime_error("Unable to open file " + path);
+    }
+    auto write_at = [&file](uint64_t section_offset, const void* data, size_t size) {
+        // pad up to the section
+        static constexpr char zeros[SNAPSHOT_ALIGNMENT]{};
+        file.write(zeros, static_cast<std::streamsize>(section_offset - static_cast<uint64_t>(file.tellp())));
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    };
+    write_at(0, &header, sizeof(header));
+    write_at(header.entities_offset, snapshot_entities.data(), snapshot_entities.size() * sizeof(SnapshotEntity));
+    write_at(header.strings_offset, strings.data(), strings.size());
+    write_at(header.mesh_renderables_offset, renderables.data(), renderables.size() * sizeof(SnapshotMeshRenderable));
+    for (size_t i = 0; i < columns.size(); ++i) {
+        write_at(header.columns_offset + i * sizeof(SnapshotColumn), &columns[i].header, sizeof(SnapshotColumn));
+    }
+    for (const Column& column : columns) {
+        write_at(column.header.entities_offset, column.entities.data(), column.entities.size() * sizeof(uint32_t));
+        write_at(column.header.data_offset, column.data.data(), column.data.size());
+    }
+    write_at(offset, nullptr, 0);
+    if (file.good() == false) {
+        throw std::runtime_error("Failed to write scene snapshot " + path);
+    }
+
+    LOG_INFO("Saved scene snapshot {}: {} entities, {} component columns", path, snapshot_entities.size(), columns.size());
+}
+
+void Scene::LoadSnapshot(const std::string& path, const SnapshotResources& resources)
+{
+    const MappedFile file(path);
+    const uint8_t* const base = file.data();
+
+    auto check = [&path](bool condition, const char* problem) {
+        if (condition == false) throw std::runtime_error("Invalid scene snapshot " + path + ": " + problem);
+    };
+    auto in_bounds = [&file](uint64_t section_offset, uint64_t count, uint64_t element_size) {
+        return section_offset % SNAPSHOT_ALIGNMENT == 0 && section_offset <= file.size() && count <= (file.size() - section_offset) / element_size;
+    };
+
+    check(file.size() >= sizeof(SnapshotHeader), "file is too small");
+    const SnapshotHeader& header = *reinterpret_cast<const SnapshotHeader*>(base);
+    check(header.magic == SNAPSHOT_MAGIC, "not a scene snapshot");
+    check(header.version == SNAPSHOT_VERSION, "unsupported version");
+    check(header.layout_hash == snapshotLayoutHash(), "saved by an incompatible build");
+    check(in_bounds(header.entities_offset, header.entity_count, sizeof(SnapshotEntity)), "entities out of bounds");
+    check(in_bounds(header.strings_offset, header.strings_size, 1), "strings out of bounds");
+    check(in_bounds(header.mesh_renderables_offset, header.mesh_renderable_count, sizeof(SnapshotMeshRenderable)), "mesh renderables out of bounds");
+    check(in_bounds(header.columns_offset, header.column_count, sizeof(SnapshotColumn)), "columns out of bounds");
+
+    const auto* snapshot_entities = reinterpret_cast<const SnapshotEntity*>(base + header.entities_offset);
+    const char* strings = reinterpret_cast<const char*>(base + header.strings_offset);
+    const auto* renderables = reinterpret_cast<const SnapshotMeshRenderable*>(base + header.mesh_renderables_offset);
+    const auto* columns = reinterpret_cast<const SnapshotColumn*>(base + header.columns_offset);
+
+    // Everything is validated before any entity is created, so a bad snapshot leaves the scene untouched.
+    for (uint32_t i = 0; i < header.entity_count; ++i) {
+        check(snapshot_entities[i].parent <= i, "child saved before its parent");
+        check(uint64_t{snapshot_entities[i].tag_offset} + snapshot_entities[i].tag_size <= header.strings_size, "tag out of bounds");
+    }
+
+    // each entity's final signature, built from the transform, the columns it appears in and its mesh renderable
+    const size_t transform_position = getComponentTypeId<TransformComponent>();
+    const size_t renderable_position = getComponentTypeId<MeshRenderableComponent>();
+    std::vector<Signature> entity_signatures(header.entity_count);
+    for (Signature& signature : entity_signatures) {
+        signature.set(transform_position);
+    }
+
+    // match the columns to this scene's component types
+    std::vector<size_t> column_positions(header.column_count);
+    Signature column_types{};
+    column_types.set(transform_position);
+    column_types.set(renderable_position);
+    for (uint32_t c = 0; c < header.column_count; ++c) {
+        const SnapshotColumn& column = columns[c];
+        check(in_bounds(column.entities_offset, column.count, sizeof(uint32_t)), "column entities out of bounds");
+        check(column.component_size != 0 && in_bounds(column.data_offset, column.count, column.component_size), "column data out of bounds");
+        size_t found = MAX_COMPONENTS;
+        registered_components_.forEachSetBit([&](size_t position) {
+            const ComponentTypeInfo& info = component_infos_[position];
+            if (info.name_hash == column.type_hash && info.size == column.component_size && info.trivially_copyable) found = position;
+        });
+        if (found == MAX_COMPONENTS) {
+            throw std::runtime_error("Scene snapshot " + path + " contains a component type that isn't registered");
+        }
+        check(column_types.test(found) == false, "component type saved more than once");
+        column_types.set(found);
+        column_positions[c] = found;
+
+        const auto* column_entities = reinterpret_cast<const uint32_t*>(base + column.entities_offset);
+        for (uint64_t k = 0; k < column.count; ++k) {
+            check(column_entities[k] < header.entity_count && (k == 0 || column_entities[k] > column_entities[k - 1]), "column entities out of order");
+            entity_signatures[column_entities[k]].set(found);
+        }
+    }
+
+    // resolve resources before creating anything
+    std::vector<MeshRenderableComponent> loaded_renderables{};
+    loaded_renderables.reserve(header.mesh_renderable_count);
+    for (uint32_t r = 0; r < header.mesh_renderable_count; ++r) {
+        const auto mesh = resources.meshes.find(renderables[r].mesh_hash);
+        const auto material = resources.materials.find(renderables[r].material_hash);
+        if (mesh == resources.meshes.end() || material == resources.materials.end()) {
+            throw std::runtime_error("Scene snapshot " + path + " refers to a mesh or material that wasn't provided");
+        }
+        check(renderables[r].entity < header.entity_count && (r == 0 || renderables[r].entity > renderables[r - 1].entity), "mesh renderables out of order");
+        entity_signatures[renderables[r].entity].set(renderable_position);
+        loaded_renderables.push_back(MeshRenderableComponent{.mesh = mesh->second, .material = material->second, .visible = renderables[r].visible != 0});
+    }
+
+    // entities with the same components are allocated together in their final archetype, like Instantiate()
+    struct Group {
+        Signature signature;
+        std::vector<uint32_t> entities; // index into the snapshot's entities, ascending
+    };
+    std::vector<Group> groups{};
+    std::unordered_map<Signature, size_t> group_indices{};
+    for (uint32_t i = 0; i < header.entity_count; ++i) {
+        auto [it, inserted] = group_indices.emplace(entity_signatures[i], groups.size());
+        if (inserted) {
+            groups.push_back(Group{entity_signatures[i], {}});
+        }
+        groups[it->second].entities.push_back(i);
+    }
+
+    std::vector<Entity> created(header.entity_count, 0);
+    std::vector<Entity> group_entities{};
+    for (const Group& group : groups) {
+        group_entities.resize(group.entities.size());
+        AllocateEntities(group.entities.size(), group.signature, group_entities.data());
+        for (size_t i = 0; i < group.entities.size(); ++i) {
+            created[group.entities[i]] = group_entities[i];
+        }
+    }
+
+    for (uint32_t i = 0; i < header.entity_count; ++i) {
+        const SnapshotEntity& snapshot_entity = snapshot_entities[i];
+        TransformComponent* t = ConstructComponent<TransformComponent>(created[i]);
+        t->position = snapshot_entity.position;
+        t->rotation = snapshot_entity.rotation;
+        t->scale = snapshot_entity.scale;
+        t->world_matrix = snapshot_entity.world_matrix;
+        t->parent = (snapshot_entity.parent == 0) ? 0 : created[snapshot_entity.parent - 1];
+        t->tag_id = InternTag(std::string(strings + snapshot_entity.tag_offset, snapshot_entity.tag_size));
+        t->is_static = snapshot_entity.is_static != 0;
+    }
+
+    // column components are trivially copyable, so they're copied straight out of the mapping
+    for (uint32_t c = 0; c < header.column_count; ++c) {
+        const SnapshotColumn& column = columns[c];
+        const size_t position = column_positions[c];
+        const auto* column_entities = reinterpret_cast<const uint32_t*>(base + column.entities_offset);
+        for (uint64_t k = 0; k < column.count; ++k) {
+            const Entity entity = created[column_entities[k]];
+            const uint8_t* source = base + column.data_offset + k * column.component_size;
+            if (sparse_sets_[position]) {
+                sparse_sets_[position]->insertCopy(entity, source);
+                *sparse_sets_[position]->getTicks(entity) = ComponentTicks{change_tick_, change_tick_};
+                continue;
+            }
+            const EntityLocation& location = entity_locations_[entityIndex(entity)];
+            Archetype* archetype = archetypes_[location.archetype].get();
+            memcpy(archetype->getComponent(location.row, position), source, column.component_size);
+            *archetype->getTicks(location.row, position) = ComponentTicks{change_tick_, change_tick_};
+        }
+    }
+
+    for (uint32_t r = 0; r < header.mesh_renderable_count; ++r) {
+        *ConstructComponent<MeshRenderableComponent>(created[renderables[r].entity]) = std::move(loaded_renderables[r]);
+    }
+
+    // entities are in hierarchy order, so each parent is linked before its children
+    for (uint32_t i = 0; i < header.entity_count; ++i) {
+        const TransformComponent* t = ReadComponent<TransformComponent>(created[i]);
+        LinkToParent(created[i], t->parent);
+        IndexEntityName(created[i], t->parent, t->tag_id);
+    }
+
+    // systems only see the snapshot's entities once all of them exist
+    for (const Group& group : groups) {
+        group_entities.resize(group.entities.size());
+        for (size_t i = 0; i < group.entities.size(); ++i) {
+            group_entities[i] = created[group.entities[i]];
+        }
+        AddNewEntitiesToSystems(group_entities.data(), group_entities.size(), group.signature);
+    }
+
+    LOG_INFO("Loaded scene snapshot {}: {} entities", path, header.entity_count);
+}
+
+} // namespace engine
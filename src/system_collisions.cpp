@@ -6,12 +6,15 @@
 
 #include "log.h"
 
+#include <algorithm>
 #include <array>
 #include <iostream>
 
+#include <glm/common.hpp>
+
 namespace engine {
 
-static AABB transformBox(const AABB& box, const glm::mat4& matrix)
+static AABB transformBox(const AABB& box, const glm::mat4x3& matrix)
 {
     const std::array<glm::vec3, 8> points{glm::vec3{box.min.x, box.min.y, box.min.z}, glm::vec3{box.min.x, box.min.y, box.max.z},
                                           glm::vec3{box.min.x, box.max.y, box.min.z}, glm::vec3{box.min.x, box.max.y, box.max.z},
@@ -57,6 +60,23 @@ static float GetBoxArea(const AABB& box)
     return front_back + left_right + top_bottom;
 }
 
+static AABB BoxUnion(const AABB& a, const AABB& b) { return AABB{glm::min(a.min, b.min), glm::max(a.max, b.max)}; }
+
+// box around both slots of a node
+static AABB NodeBounds(const CollisionSystem::BiTreeNode& node)
+{
+    using Type = CollisionSystem::BiTreeNode::Type;
+    if (node.type1 == Type::Empty) return node.box2;
+    if (node.type2 == Type::Empty) return node.box1;
+    return BoxUnion(node.box1, node.box2);
+}
+
+// which slot of 'parent' holds the bounding volume 'child'
+static uint32_t ChildSlot(const CollisionSystem::BiTreeNode& parent, uint32_t child)
+{
+    return (parent.type1 == CollisionSystem::BiTreeNode::Type::BoundingVolume && parent.index1 == child) ? 0 : 1;
+}
+
 // returns true on hit and tmin
 // also modifies 'side' reference
 static std::pair<bool, float> RayBoxIntersection(const Ray& ray, const AABB& box, float t, AABBSide& side)
@@ -101,60 +121,307 @@ static std::pair<bool, float> RayBoxIntersection(const Ray& ray, const AABB& box
 
 // class methods
 
-CollisionSystem::CollisionSystem(Scene* scene) : System(scene, {typeid(TransformComponent).hash_code(), typeid(ColliderComponent).hash_code()}) {}
+CollisionSystem::CollisionSystem(Scene* scene) : System(scene, {getComponentTypeId<TransformComponent>(), getComponentTypeId<ColliderComponent>()})
+{
+    // only the BVH is written, which belongs to this system
+    declareAccess({getComponentTypeId<TransformComponent>(), getComponentTypeId<ColliderComponent>()}, {});
+}
+
+void CollisionSystem::onComponentInsert(Entity entity) { pending_inserts_.push_back(entity); }
 
-void CollisionSystem::onComponentInsert(Entity entity)
+void CollisionSystem::onComponentRemove(Entity entity)
 {
-    (void)entity;
-    ++colliders_size_now_;
+    if (needs_rebuild_ == false) RemoveLeaf(entity);
 }
 
 void CollisionSystem::onUpdate(float ts)
 {
     (void)ts;
 
-    // TODO: the bvh will not update if an equal number of colliders are removed and added.
-    // This is not a problem yet, as entitites cannot be removed from the scene.
-    //
-    // (a long time later), just use a bool flag like 'is_out_of_date' when component is inserted or removed, reset after rebuilding. EZPZ.
-    // if (colliders_size_last_update_ != colliders_size_now_) {
-    if (1 == 1) { // always rebuild
-
-        std::vector<PrimitiveInfo> prims{};
-        prims.reserve(m_entities.size());
-        for (Entity entity : m_entities) {
-            const auto t = m_scene->GetComponent<TransformComponent>(entity);
-            const auto c = m_scene->GetComponent<ColliderComponent>(entity);
+    // inserting one collider at a time builds a poor tree, so large batches of new colliders (like a level loading) go through a rebuild
+    if (needs_rebuild_ || pending_inserts_.size() > leaf_count_) {
+        RebuildTree();
+        return;
+    }
 
-            const AABB box = transformBox(c->aabb, t->world_matrix);
+    for (Entity entity : pending_inserts_) {
+        // it may have been destroyed or lost its collider since
+        if (m_entities.contains(entity) == false) continue;
+        // A collider replaced before this update was pending twice. Its removal did nothing as it wasn't in the tree yet.
+        if (entityIndex(entity) < entity_leaves_.size() && entity_leaves_[entityIndex(entity)].node != NO_NODE) continue;
+        const TransformComponent* transform = m_scene->ReadComponent<TransformComponent>(entity);
+        const ColliderComponent* collider = m_scene->ReadComponent<ColliderComponent>(entity);
+        InsertLeaf(entity, transformBox(collider->aabb, transform->world_matrix));
+    }
+    pending_inserts_.clear();
 
-            prims.emplace_back(box, entity);
+    // only colliders that were moved or resized since the last update are refitted
+    const uint32_t since = m_last_run_tick;
+    auto refit = [this](auto view) {
+        if (batch_prims_.size() < view.batchCount()) {
+            batch_prims_.resize(view.batchCount());
+        }
+        view.parallelEach([this](size_t batch, Entity entity, const TransformComponent& transform, const ColliderComponent& collider) {
+            batch_prims_[batch].emplace_back(transformBox(collider.aabb, transform.world_matrix), entity);
+        });
+        for (std::vector<PrimitiveInfo>& prims : batch_prims_) {
+            for (const PrimitiveInfo& prim : prims) {
+                RefitLeaf(prim.entity, prim.box);
+            }
+            prims.clear();
         }
+    };
+    refit(m_scene->View<const TransformComponent, const ColliderComponent>().where<Changed<TransformComponent>>(since));
+    refit(m_scene->View<const TransformComponent, const ColliderComponent>().where<Changed<ColliderComponent>>(since));
+
+    // a tree built with no bounding volumes has no cost, but shouldn't be rebuilt on every insert
+    if (TreeCost() > std::max(built_cost_, 1.0f) * REBUILD_COST_RATIO) {
+        LOG_DEBUG("BVH cost grew from {} to {}, rebuilding", built_cost_, TreeCost());
+        RebuildTree();
+    }
+}
 
-        bvh_.clear();
-        bvh_.reserve(m_entities.size() * 3 / 2); // from testing, bvh is usually 20% larger than number of objects
+void CollisionSystem::RebuildTree()
+{
+    std::vector<PrimitiveInfo> prims{};
+    prims.reserve(m_entities.size());
+    auto view = m_scene->View<const TransformComponent, const ColliderComponent>();
+    if (batch_prims_.size() < view.batchCount()) {
+        batch_prims_.resize(view.batchCount());
+    }
+    view.parallelEach([this](size_t batch, Entity entity, const TransformComponent& transform, const ColliderComponent& collider) {
+        batch_prims_[batch].emplace_back(transformBox(collider.aabb, transform.world_matrix), entity);
+    });
+    // merged in batch order so the BVH comes out the same regardless of thread timing
+    AppendBatches(batch_prims_, prims);
+
+    bvh_.clear();
+    bvh_.reserve(m_entities.size() * 3 / 2); // from testing, bvh is usually 20% larger than number of objects
+    if (prims.empty() == false) {
         BuildNode(prims, bvh_);
+    }
 
 #ifndef NDEBUG
-        // check AABB mins and maxes are the correct order
-        for (const auto& node : bvh_) {
-            if (node.type1 != BiTreeNode::Type::Empty) {
-                if (node.box1.max.x < node.box1.min.x) abort();
-                if (node.box1.max.y < node.box1.min.y) abort();
-                if (node.box1.max.z < node.box1.min.z) abort();
+    // check AABB mins and maxes are the correct order
+    for (const auto& node : bvh_) {
+        if (node.type1 != BiTreeNode::Type::Empty) {
+            if (node.box1.max.x < node.box1.min.x) abort();
+            if (node.box1.max.y < node.box1.min.y) abort();
+            if (node.box1.max.z < node.box1.min.z) abort();
+        }
+        if (node.type2 != BiTreeNode::Type::Empty) {
+            if (node.box2.max.x < node.box2.min.x) abort();
+            if (node.box2.max.y < node.box2.min.y) abort();
+            if (node.box2.max.z < node.box2.min.z) abort();
+        }
+    }
+#endif
+
+    // BuildNode() adds the root last
+    root_ = bvh_.empty() ? NO_NODE : static_cast<uint32_t>(bvh_.size() - 1);
+    node_parents_.assign(bvh_.size(), NO_NODE);
+    free_nodes_.clear();
+    std::fill(entity_leaves_.begin(), entity_leaves_.end(), LeafLocation{});
+    leaf_count_ = 0;
+    bounding_volume_area_ = 0.0;
+    for (uint32_t i = 0; i < bvh_.size(); ++i) {
+        const BiTreeNode& node = bvh_[i];
+        for (uint32_t slot = 0; slot < 2; ++slot) {
+            const BiTreeNode::Type type = (slot == 0) ? node.type1 : node.type2;
+            const uint32_t index = (slot == 0) ? node.index1 : node.index2;
+            if (type == BiTreeNode::Type::BoundingVolume) {
+                node_parents_[index] = i;
+                bounding_volume_area_ += GetBoxArea((slot == 0) ? node.box1 : node.box2);
             }
-            if (node.type2 != BiTreeNode::Type::Empty) {
-                if (node.box2.max.x < node.box2.min.x) abort();
-                if (node.box2.max.y < node.box2.min.y) abort();
-                if (node.box2.max.z < node.box2.min.z) abort();
+            else if (type == BiTreeNode::Type::Entity) {
+                if (entityIndex(index) >= entity_leaves_.size()) entity_leaves_.resize(entityIndex(index) + 1);
+                entity_leaves_[entityIndex(index)] = LeafLocation{i, slot};
+                ++leaf_count_;
             }
         }
-#endif
+    }
+    built_cost_ = TreeCost();
+    pending_inserts_.clear();
+    needs_rebuild_ = false;
+
+    LOG_DEBUG("BUILT BVH!");
+}
+
+void CollisionSystem::InsertLeaf(Entity entity, const AABB& box)
+{
+    if (entityIndex(entity) >= entity_leaves_.size()) entity_leaves_.resize(entityIndex(entity) + 1);
+    ++leaf_count_;
+
+    if (root_ == NO_NODE) {
+        root_ = AllocateNode(NO_NODE);
+        SetSlot(root_, 0, box, entity, BiTreeNode::Type::Entity);
+        entity_leaves_[entityIndex(entity)] = LeafLocation{root_, 0};
+        return;
+    }
+
+    // descend towards whichever child grows the least from holding the new box, enlarging boxes on the way down
+    uint32_t node = root_;
+    while (true) {
+        const BiTreeNode& n = bvh_[node];
+        if (n.type1 == BiTreeNode::Type::Empty || n.type2 == BiTreeNode::Type::Empty) {
+            const uint32_t slot = (n.type1 == BiTreeNode::Type::Empty) ? 0 : 1;
+            SetSlot(node, slot, box, entity, BiTreeNode::Type::Entity);
+            entity_leaves_[entityIndex(entity)] = LeafLocation{node, slot};
+            RefitUpwards(node);
+            return;
+        }
+
+        const float growth1 = GetBoxArea(BoxUnion(n.box1, box)) - GetBoxArea(n.box1);
+        const float growth2 = GetBoxArea(BoxUnion(n.box2, box)) - GetBoxArea(n.box2);
+        const uint32_t slot = (growth1 <= growth2) ? 0 : 1;
+        const AABB slot_box = (slot == 0) ? n.box1 : n.box2;
+        const uint32_t index = (slot == 0) ? n.index1 : n.index2;
+        if (((slot == 0) ? n.type1 : n.type2) == BiTreeNode::Type::BoundingVolume) {
+            SetSlotBox(node, slot, BoxUnion(slot_box, box));
+            node = index;
+            continue;
+        }
+
+        // the entity in that slot and the new one become children of a new node
+        const uint32_t pair = AllocateNode(node);
+        SetSlot(pair, 0, slot_box, index, BiTreeNode::Type::Entity);
+        entity_leaves_[entityIndex(index)] = LeafLocation{pair, 0};
+        SetSlot(pair, 1, box, entity, BiTreeNode::Type::Entity);
+        entity_leaves_[entityIndex(entity)] = LeafLocation{pair, 1};
+        SetSlot(node, slot, BoxUnion(slot_box, box), pair, BiTreeNode::Type::BoundingVolume);
+        return;
+    }
+}
+
+void CollisionSystem::RemoveLeaf(Entity entity)
+{
+    if (entityIndex(entity) >= entity_leaves_.size()) return;
+    const LeafLocation location = entity_leaves_[entityIndex(entity)];
+    // colliders still waiting to be inserted aren't in the tree
+    if (location.node == NO_NODE) return;
+
+    entity_leaves_[entityIndex(entity)] = LeafLocation{};
+    --leaf_count_;
+    RemoveSlot(location.node, location.slot);
+}
+
+void CollisionSystem::RefitLeaf(Entity entity, const AABB& box)
+{
+    const LeafLocation location = entity_leaves_[entityIndex(entity)];
+    if (location.node == NO_NODE) return;
+    SetSlotBox(location.node, location.slot, box);
+    RefitUpwards(location.node);
+}
+
+void CollisionSystem::RemoveSlot(uint32_t node, uint32_t slot)
+{
+    SetSlot(node, slot, AABB{}, 0, BiTreeNode::Type::Empty);
+
+    const BiTreeNode& n = bvh_[node];
+    const uint32_t other = 1 - slot;
+    const BiTreeNode::Type other_type = (other == 0) ? n.type1 : n.type2;
+    const uint32_t parent = node_parents_[node];
+
+    if (other_type == BiTreeNode::Type::Empty) {
+        // nothing left under this node
+        FreeNode(node);
+        if (node == root_) {
+            root_ = NO_NODE;
+        }
+        else {
+            RemoveSlot(parent, ChildSlot(bvh_[parent], node));
+        }
+        return;
+    }
 
-        LOG_DEBUG("BUILT BVH!");
+    const AABB other_box = (other == 0) ? n.box1 : n.box2;
+    const uint32_t other_index = (other == 0) ? n.index1 : n.index2;
+    if (node == root_) {
+        // a root with a single bounding volume hands over to it
+        if (other_type == BiTreeNode::Type::BoundingVolume) {
+            FreeNode(node);
+            root_ = other_index;
+            node_parents_[root_] = NO_NODE;
+        }
+        return;
+    }
 
-        colliders_size_last_update_ = colliders_size_now_;
+    // the remaining child takes this node's place in its parent
+    const uint32_t parent_slot = ChildSlot(bvh_[parent], node);
+    FreeNode(node);
+    SetSlot(parent, parent_slot, other_box, other_index, other_type);
+    if (other_type == BiTreeNode::Type::BoundingVolume) {
+        node_parents_[other_index] = parent;
     }
+    else {
+        entity_leaves_[entityIndex(other_index)] = LeafLocation{parent, parent_slot};
+    }
+    RefitUpwards(parent);
+}
+
+void CollisionSystem::RefitUpwards(uint32_t node)
+{
+    while (node != root_) {
+        const uint32_t parent = node_parents_[node];
+        const uint32_t slot = ChildSlot(bvh_[parent], node);
+        const AABB bounds = NodeBounds(bvh_[node]);
+        const AABB& current = (slot == 0) ? bvh_[parent].box1 : bvh_[parent].box2;
+        if (current.min == bounds.min && current.max == bounds.max) return;
+        SetSlotBox(parent, slot, bounds);
+        node = parent;
+    }
+}
+
+void CollisionSystem::SetSlot(uint32_t node, uint32_t slot, const AABB& box, uint32_t index, BiTreeNode::Type type)
+{
+    BiTreeNode& n = bvh_[node];
+    AABB& slot_box = (slot == 0) ? n.box1 : n.box2;
+    BiTreeNode::Type& slot_type = (slot == 0) ? n.type1 : n.type2;
+    if (slot_type == BiTreeNode::Type::BoundingVolume) bounding_volume_area_ -= GetBoxArea(slot_box);
+    if (type == BiTreeNode::Type::BoundingVolume) bounding_volume_area_ += GetBoxArea(box);
+    slot_box = box;
+    slot_type = type;
+    ((slot == 0) ? n.index1 : n.index2) = index;
+}
+
+void CollisionSystem::SetSlotBox(uint32_t node, uint32_t slot, const AABB& box)
+{
+    const BiTreeNode& n = bvh_[node];
+    SetSlot(node, slot, box, (slot == 0) ? n.index1 : n.index2, (slot == 0) ? n.type1 : n.type2);
+}
+
+uint32_t CollisionSystem::AllocateNode(uint32_t parent)
+{
+    uint32_t node;
+    if (free_nodes_.empty() == false) {
+        node = free_nodes_.back();
+        free_nodes_.pop_back();
+    }
+    else {
+        node = static_cast<uint32_t>(bvh_.size());
+        bvh_.emplace_back();
+        node_parents_.push_back(NO_NODE);
+    }
+    bvh_[node].type1 = BiTreeNode::Type::Empty;
+    bvh_[node].type2 = BiTreeNode::Type::Empty;
+    node_parents_[node] = parent;
+    return node;
+}
+
+void CollisionSystem::FreeNode(uint32_t node)
+{
+    SetSlot(node, 0, AABB{}, 0, BiTreeNode::Type::Empty);
+    SetSlot(node, 1, AABB{}, 0, BiTreeNode::Type::Empty);
+    node_parents_[node] = NO_NODE;
+    free_nodes_.push_back(node);
+}
+
+float CollisionSystem::TreeCost() const
+{
+    if (root_ == NO_NODE) return 0.0f;
+    const float root_area = GetBoxArea(NodeBounds(bvh_[root_]));
+    if (root_area <= 0.0f) return 0.0f;
+    return static_cast<float>(bounding_volume_area_ / root_area);
 }
 
 Raycast CollisionSystem::GetRaycast(Ray ray)
@@ -164,8 +431,8 @@ Raycast CollisionSystem::GetRaycast(Ray ray)
     Raycast res{};
     res.hit = false;
 
-    if (!bvh_.empty()) {
-        const RaycastTreeNodeResult tree_node_cast_res = RaycastTreeNode(ray, bvh_.back());
+    if (root_ != NO_NODE) {
+        const RaycastTreeNodeResult tree_node_cast_res = RaycastTreeNode(ray, bvh_[root_]);
         if (tree_node_cast_res.hit) {
             res.hit = true;
             res.distance = tree_node_cast_res.t;
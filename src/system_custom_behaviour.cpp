@@ -1,14 +1,12 @@
 #include "system_custom_behaviour.h"
 
-#include <typeinfo>
-
 #include "component_custom.h"
 #include "component_transform.h"
 #include "scene.h"
 
 namespace engine {
 
-CustomBehaviourSystem::CustomBehaviourSystem(Scene* scene) : System(scene, {typeid(TransformComponent).hash_code(), typeid(CustomComponent).hash_code()})
+CustomBehaviourSystem::CustomBehaviourSystem(Scene* scene) : System(scene, {getComponentTypeId<TransformComponent>(), getComponentTypeId<CustomComponent>()})
 {
     // constructor here
 }
@@ -17,21 +15,32 @@ CustomBehaviourSystem::~CustomBehaviourSystem() {}
 
 void CustomBehaviourSystem::onUpdate(float ts)
 {
-    for (Entity entity : m_entities) {
-        auto c = m_scene->GetComponent<CustomComponent>(entity);
-        assert(c != nullptr);
-        assert(c->impl != nullptr);
+    // custom components are few, so walk their pool rather than looking each one up
+    SparseSet<CustomComponent>* custom_components = m_scene->GetSparseSet<CustomComponent>();
+    // The pool must not change while it's walked: behaviours that add or remove components or entities
+    // have to defer it through m_scene->GetCommandBuffer(), which is played back after the update.
+    const size_t count = custom_components->size();
+    const Entity* entities = custom_components->getEntities().data();
+    const CustomComponent* components = custom_components->getComponents();
+    for (size_t i = 0; i < count; ++i) {
+        assert(custom_components->size() == count && "Custom component added or removed while updating. Use Scene::GetCommandBuffer().");
+        const Entity entity = entities[i];
+        if (m_entities.contains(entity) == false) continue;
+        ComponentCustomImpl* impl = components[i].impl.get();
+        assert(impl != nullptr);
         bool& entity_initialised = m_entity_is_initialised.at(entity);
         if (entity_initialised == false) {
-            c->impl->m_entity = entity;
-            c->impl->m_scene = m_scene;
-            c->impl->init();
+            impl->m_entity = entity;
+            impl->m_scene = m_scene;
+            impl->init();
             entity_initialised = true;
         }
-        c->impl->update(ts);
+        impl->update(ts);
     }
 }
 
 void CustomBehaviourSystem::onComponentInsert(Entity entity) { m_entity_is_initialised.emplace(entity, false); }
 
+void CustomBehaviourSystem::onComponentRemove(Entity entity) { m_entity_is_initialised.erase(entity); }
+
 } // namespace engine
\ No newline at end of file
@@ -6,10 +6,15 @@
 #include "component_transform.h"
 #include "log.h"
 #include "resource_material.h"
+#include "system_transform.h"
 
 namespace engine {
 
-MeshRenderSystem::MeshRenderSystem(Scene* scene) : System(scene, {typeid(TransformComponent).hash_code(), typeid(MeshRenderableComponent).hash_code()}) {}
+MeshRenderSystem::MeshRenderSystem(Scene* scene) : System(scene, {getComponentTypeId<TransformComponent>(), getComponentTypeId<MeshRenderableComponent>()})
+{
+    // only the render lists are written, which belong to this system
+    declareAccess({getComponentTypeId<TransformComponent>(), getComponentTypeId<MeshRenderableComponent>()}, {});
+}
 
 MeshRenderSystem::~MeshRenderSystem() {}
 
@@ -23,18 +28,84 @@ void MeshRenderSystem::onComponentInsert(Entity entity)
 {
     (void)entity;
     list_needs_rebuild_ = true;
+    dynamic_list_needs_rebuild_ = true;
+}
+
+void MeshRenderSystem::onComponentRemove(Entity entity)
+{
+    (void)entity;
+    list_needs_rebuild_ = true; // the static list may reference the removed mesh
+    dynamic_list_needs_rebuild_ = true;
 }
 
 void MeshRenderSystem::onUpdate(float ts)
 {
-    // do stuff
     (void)ts;
-    // update the static render list only if it needs updating
+
+    const uint32_t since = m_last_run_tick;
+
+    // a changed renderable may have been hidden or given a different mesh or material
+    if (m_scene->View<const MeshRenderableComponent>().where<Changed<MeshRenderableComponent>>(since).empty() == false) {
+        list_needs_rebuild_ = true;
+        dynamic_list_needs_rebuild_ = true;
+    }
+
+    // moved dynamic meshes are updated in place, anything else that changed means rebuilding a list
+    if (dynamic_list_needs_rebuild_ == false) {
+        for (auto [entity, transform, renderable] :
+             m_scene->View<const TransformComponent, const MeshRenderableComponent>().where<Changed<TransformComponent>>(since)) {
+            RenderListEntry* entry = FindDynamicEntry(entity);
+            if (transform.is_static) {
+                list_needs_rebuild_ = true;
+                if (entry) dynamic_list_needs_rebuild_ = true; // became static
+            }
+            else if (entry) {
+                entry->model_matrix = glm::mat4(transform.world_matrix);
+            }
+            else if (renderable.visible) {
+                dynamic_list_needs_rebuild_ = true; // became dynamic
+            }
+        }
+    }
+
     if (list_needs_rebuild_) {
         RebuildStaticRenderList();
     }
-    // update the dynamic render list always
-    BuildRenderList(dynamic_render_list_, false);
+    if (dynamic_list_needs_rebuild_) {
+        for (const RenderListEntry& entry : dynamic_render_list_) {
+            dynamic_entry_indices_[entityIndex(entry.entity)] = UINT32_MAX;
+        }
+        BuildRenderList(dynamic_render_list_, false);
+        for (uint32_t i = 0; i < dynamic_render_list_.size(); ++i) {
+            const uint32_t index = entityIndex(dynamic_render_list_[i].entity);
+            if (index >= dynamic_entry_indices_.size()) dynamic_entry_indices_.resize(index + 1, UINT32_MAX);
+            dynamic_entry_indices_[index] = i;
+        }
+        dynamic_list_needs_rebuild_ = false;
+    }
+}
+
+const RenderList* MeshRenderSystem::GetInterpolatedDynamicRenderList(float alpha)
+{
+    if (alpha >= 1.0f) return &dynamic_render_list_;
+
+    const TransformSystem* const transform_system = m_scene->GetSystem<TransformSystem>();
+    interpolated_dynamic_render_list_ = dynamic_render_list_;
+    for (RenderListEntry& entry : interpolated_dynamic_render_list_) {
+        if (const glm::mat4x3* previous = transform_system->GetPreviousWorldMatrix(entry.entity)) {
+            entry.model_matrix = glm::mat4(TransformSystem::InterpolateMatrix(*previous, glm::mat4x3(entry.model_matrix), alpha));
+        }
+    }
+    return &interpolated_dynamic_render_list_;
+}
+
+RenderListEntry* MeshRenderSystem::FindDynamicEntry(Entity entity)
+{
+    const uint32_t index = entityIndex(entity);
+    if (index >= dynamic_entry_indices_.size() || dynamic_entry_indices_[index] == UINT32_MAX) return nullptr;
+    RenderListEntry& entry = dynamic_render_list_[dynamic_entry_indices_[index]];
+    // the index may have been reused by a newer entity
+    return (entry.entity == entity) ? &entry : nullptr;
 }
 
 void MeshRenderSystem::BuildRenderList(RenderList& render_list, bool with_static_entities)
@@ -42,29 +113,45 @@ void MeshRenderSystem::BuildRenderList(RenderList& render_list, bool with_static
     render_list.clear();
     render_list.reserve(m_entities.size());
 
-    std::unordered_map<const gfx::Pipeline*, int> render_orders;
-
-    for (Entity entity : m_entities) {
-        auto transform = m_scene->GetComponent<engine::TransformComponent>(entity);
+    auto view = m_scene->View<const TransformComponent, const MeshRenderableComponent>();
 
-        if (transform->is_static != with_static_entities) continue;
+    // each batch gets its own output, merged below in batch order so the list doesn't depend on thread timing
+    if (render_list_batches_.size() < view.batchCount()) {
+        render_list_batches_.resize(view.batchCount());
+    }
+    for (RenderListBatch& batch : render_list_batches_) {
+        batch.entries.clear();
+        batch.render_orders.clear();
+    }
 
-        auto renderable = m_scene->GetComponent<engine::MeshRenderableComponent>(entity);
+    view.parallelEach([this, with_static_entities](size_t batch_index, Entity entity, const TransformComponent& transform,
+                                                   const MeshRenderableComponent& renderable) {
+        if (transform.is_static != with_static_entities) return;
 
-        if (renderable->visible == false) continue;
+        if (renderable.visible == false) return;
 
-        const gfx::Pipeline* pipeline = renderable->material->getShader()->GetPipeline();
+        RenderListBatch& batch = render_list_batches_[batch_index];
+        const gfx::Pipeline* pipeline = renderable.material->getShader()->GetPipeline();
 
-        render_list.emplace_back(RenderListEntry{.pipeline = pipeline,
-                                                 .vertex_buffer = renderable->mesh->getVB(),
-                                                 .index_buffer = renderable->mesh->getIB(),
-                                                 .material_set = renderable->material->getDescriptorSet(),
-                                                 .model_matrix = transform->world_matrix,
-                                                 .index_count = renderable->mesh->getCount()});
+        batch.entries.emplace_back(RenderListEntry{.pipeline = pipeline,
+                                                   .vertex_buffer = renderable.mesh->getVB(),
+                                                   .index_buffer = renderable.mesh->getIB(),
+                                                   .material_set = renderable.material->getDescriptorSet(),
+                                                   .model_matrix = glm::mat4(transform.world_matrix),
+                                                   .index_count = renderable.mesh->getCount(),
+                                                   .entity = entity});
 
-        if (render_orders.contains(pipeline) == false) {
-            render_orders.emplace(pipeline, renderable->material->getShader()->GetRenderOrder());
+        // a batch only sees a handful of pipelines
+        auto it = std::find_if(batch.render_orders.begin(), batch.render_orders.end(), [pipeline](const auto& order) { return order.first == pipeline; });
+        if (it == batch.render_orders.end()) {
+            batch.render_orders.emplace_back(pipeline, renderable.material->getShader()->GetRenderOrder());
         }
+    });
+
+    std::unordered_map<const gfx::Pipeline*, int> render_orders;
+    for (RenderListBatch& batch : render_list_batches_) {
+        render_list.insert(render_list.end(), batch.entries.begin(), batch.entries.end());
+        render_orders.insert(batch.render_orders.begin(), batch.render_orders.end());
     }
 
     // sort the meshes by pipeline
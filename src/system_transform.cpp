@@ -1,53 +1,248 @@
 #include "system_transform.h"
 
+#include <algorithm>
+
 #include "scene.h"
 #include "component_transform.h"
 
-#include <typeinfo>
-
 namespace engine {
 
-TransformSystem::TransformSystem(Scene* scene) : System(scene, {typeid(TransformComponent).hash_code()}) {}
+TransformSystem::TransformSystem(Scene* scene) : System(scene, {getComponentTypeId<TransformComponent>()})
+{
+    declareAccess({}, {getComponentTypeId<TransformComponent>()});
+}
+
+static glm::mat4x3 LocalMatrix(const TransformComponent& t)
+{
+    glm::mat4 transform;
+
+    // rotation
+    transform = glm::mat4_cast(t.rotation);
+    // position
+    reinterpret_cast<glm::vec3&>(transform[3]) = t.position;
+    // scale (effectively applied first)
+    transform = glm::scale(transform, t.scale);
+
+    return glm::mat4x3(transform);
+}
 
 void TransformSystem::onUpdate(float ts)
 {
     (void)ts;
 
-    for (Entity entity : m_entities) {
-        auto t = m_scene->GetComponent<TransformComponent>(entity);
+    const uint32_t since = m_last_run_tick;
+    ++step_count_;
 
-        glm::mat4 transform;
+    // a reparented subtree would have to move behind its new parent, so it's laid out again from scratch
+    if (slots_reparent_version_ != m_scene->GetReparentVersion() || tombstone_count_ > slot_entities_.size() * MAX_TOMBSTONE_RATIO) {
+        RebuildSlots();
+    }
+    else if (AppendPendingSlots() == false) {
+        RebuildSlots();
+    }
 
-        // rotation
-        transform = glm::mat4_cast(t->rotation);
-        // position
-        reinterpret_cast<glm::vec3&>(transform[3]) = t->position;
-        // scale (effectively applied first)
-        transform = glm::scale(transform, t->scale);
+    // gathered into arrays the batched kernel can load several transforms at a time from
+    changed_slots_.clear();
+    changed_trs_.clear();
+    bool static_changed = false;
+    bool layout_stale = false;
+    m_scene->View<const TransformComponent>().where<Changed<TransformComponent>>(since).each([&, this](Entity entity, const TransformComponent& t) {
+        const uint32_t slot = entity_slots_[entityIndex(entity)];
+        changed_slots_.push_back(slot);
+        changed_trs_.push(t.position, t.rotation, t.scale);
+        const bool in_static_slot = slot < first_dynamic_slot_;
+        static_changed |= in_static_slot;
+        layout_stale |= (t.is_static != in_static_slot);
+    });
 
-        if (t->parent != 0) {
-            auto parent_t = m_scene->GetComponent<TransformComponent>(t->parent);
-            transform = parent_t->world_matrix * transform;
+    // local matrices don't depend on each other, so they are built across the job system
+    changed_local_matrices_.resize(changed_slots_.size());
+    auto compose = [this](size_t begin, size_t end) {
+        ComposeTransforms(changed_trs_, begin, end, changed_local_matrices_.data() + begin);
+        for (size_t i = begin; i < end; ++i) {
+            slot_local_matrices_[changed_slots_[i]] = changed_local_matrices_[i];
+            slot_dirty_[changed_slots_[i]] = 1;
+        }
+    };
+    if (JobSystem* job_system = m_scene->job_system()) {
+        job_system->parallelFor(changed_slots_.size(), COMPOSE_CHUNK_SIZE, compose);
+    }
+    else {
+        compose(0, changed_slots_.size());
+    }
+
+    if (layout_stale) {
+        // is_static was toggled, move the transform across the static/dynamic boundary and resolve everything again
+        RebuildSlots();
+        std::fill(slot_dirty_.begin(), slot_dirty_.end(), uint8_t{1});
+        static_changed = true;
+    }
+
+    // Static transforms are frozen after being resolved once, so they're only visited again if one of them was written to.
+    const uint32_t begin = static_changed ? 0 : first_dynamic_slot_;
+    const uint32_t end = static_cast<uint32_t>(slot_entities_.size());
+
+    // interpolation needs the world matrix each transform had before this step
+    const bool keep_previous = m_scene->GetFixedTimestep() > 0.0f;
+
+    // Unchanged transforms are only updated when their parent was
+    dirty_slots_.clear();
+    child_slots_.clear();
+    for (uint32_t slot = begin; slot < end; ++slot) {
+        // tombstones have no children, as children are destroyed before their parents
+        if (slot_entities_[slot] == 0) continue;
+        const uint32_t parent = slot_parents_[slot];
+        if (parent != NO_PARENT && slot_dirty_[parent]) slot_dirty_[slot] = 1;
+        if (slot_dirty_[slot] == 0) continue;
 
-            // (debug builds only) ensure static objects have static parents
-            assert(t->is_static == false || parent_t->is_static == true);
+        dirty_slots_.push_back(slot);
+        const Entity entity = slot_entities_[slot];
+        // new transforms don't have a previous world matrix
+        if (keep_previous && m_scene->GetComponentTicks<TransformComponent>(entity)->added <= since) {
+            slot_previous_world_matrices_[slot] = slot_world_matrices_[slot];
+            slot_previous_steps_[slot] = step_count_;
         }
+        if (parent == NO_PARENT) {
+            slot_world_matrices_[slot] = slot_local_matrices_[slot];
+        }
+        else {
+            child_slots_.push_back(slot);
+        }
+    }
+    // Parents come before their children, so a parent's world matrix is always final by the time its children read it.
+    MultiplyAffineTransforms(slot_world_matrices_.data(), slot_local_matrices_.data(), slot_parents_.data(), child_slots_.data(), child_slots_.size());
 
-        t->world_matrix = transform;
+    for (uint32_t slot : dirty_slots_) {
+        TransformComponent* t = m_scene->GetComponent<TransformComponent>(slot_entities_[slot]);
+        t->world_matrix = slot_world_matrices_[slot];
+
+        // (debug builds only) ensure static objects have static parents
+        assert(slot_parents_[slot] == NO_PARENT || t->is_static == false ||
+               m_scene->ReadComponent<TransformComponent>(slot_entities_[slot_parents_[slot]])->is_static == true);
     }
+    // cleared after the pass as children look at their parent's flag
+    std::fill(slot_dirty_.begin() + begin, slot_dirty_.begin() + end, uint8_t{0});
 }
 
-Entity TransformSystem::GetChildEntity(Entity parent, const std::string& tag)
+void TransformSystem::onComponentInsert(Entity entity)
 {
-    for (Entity entity : m_entities) {
-        auto t = m_scene->GetComponent<TransformComponent>(entity);
-        if (t->parent == parent) {
-            if (t->tag == tag) {
-                return entity;
-            }
-        }
+    const uint32_t index = entityIndex(entity);
+    if (index >= entity_slots_.size()) entity_slots_.resize(index + 1, NO_SLOT);
+    entity_slots_[index] = NO_SLOT;
+    pending_entities_.push_back(entity);
+}
+
+void TransformSystem::onComponentRemove(Entity entity)
+{
+    uint32_t& slot = entity_slots_[entityIndex(entity)];
+    if (slot == NO_SLOT) return; // still pending, skipped when appending
+    slot_entities_[slot] = 0;
+    slot_parents_[slot] = NO_PARENT;
+    slot_dirty_[slot] = 0;
+    slot = NO_SLOT;
+    ++tombstone_count_;
+}
+
+bool TransformSystem::AppendPendingSlots()
+{
+    for (Entity entity : pending_entities_) {
+        // entities destroyed before they were laid out
+        if (m_entities.contains(entity) == false) continue;
+        if (AppendSlot(entity) == NO_SLOT) return false;
     }
-    return 0;
+    pending_entities_.clear();
+    return true;
+}
+
+uint32_t TransformSystem::AppendSlot(Entity entity)
+{
+    const uint32_t index = entityIndex(entity);
+    if (entity_slots_[index] != NO_SLOT) return entity_slots_[index];
+
+    // Systems hear about new entities in groups of matching components rather than in hierarchy order, so a parent may still be pending.
+    // The end of the slots comes after every parent, keeping parents before their children.
+    const TransformComponent* t = m_scene->ReadComponent<TransformComponent>(entity);
+    const uint32_t parent_slot = (t->parent == 0) ? NO_PARENT : AppendSlot(t->parent);
+    if (t->parent != 0 && parent_slot == NO_SLOT) return NO_SLOT;
+    // a static transform whose parent is static belongs with the static slots before 'first_dynamic_slot_'
+    if (t->is_static && (parent_slot == NO_PARENT || parent_slot < first_dynamic_slot_)) return NO_SLOT;
+
+    const uint32_t slot = static_cast<uint32_t>(slot_entities_.size());
+    slot_entities_.push_back(entity);
+    slot_parents_.push_back(parent_slot);
+    slot_local_matrices_.push_back(LocalMatrix(*t));
+    slot_world_matrices_.push_back(t->world_matrix);
+    slot_dirty_.push_back(1);
+    slot_previous_world_matrices_.emplace_back();
+    slot_previous_steps_.push_back(0);
+    entity_slots_[index] = slot;
+    return slot;
+}
+
+void TransformSystem::RebuildSlots()
+{
+    // breadth-first, so each entity's children are appended after it
+    std::vector<Entity> order{};
+    std::vector<uint32_t> order_parents{};
+    m_scene->ForEachChild(0, [&](Entity root) {
+        order.push_back(root);
+        order_parents.push_back(NO_PARENT);
+    });
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        m_scene->ForEachChild(order[i], [&, i](Entity child) {
+            order.push_back(child);
+            order_parents.push_back(i);
+        });
+    }
+
+    // Static transforms go first, keeping their breadth-first order. A static transform under a dynamic one (which onUpdate() asserts against)
+    // is kept with the dynamic ones so that parents still come before their children.
+    const size_t count = order.size();
+    std::vector<uint8_t> order_static(count);
+    for (size_t i = 0; i < count; ++i) {
+        const bool parent_static = order_parents[i] == NO_PARENT || order_static[order_parents[i]];
+        order_static[i] = (parent_static && m_scene->ReadComponent<TransformComponent>(order[i])->is_static) ? 1 : 0;
+    }
+    std::vector<uint32_t> order_slots(count);
+    uint32_t next_slot = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (order_static[i]) order_slots[i] = next_slot++;
+    }
+    first_dynamic_slot_ = next_slot;
+    for (size_t i = 0; i < count; ++i) {
+        if (order_static[i] == 0) order_slots[i] = next_slot++;
+    }
+
+    slot_entities_.resize(count);
+    slot_parents_.resize(count);
+    slot_local_matrices_.resize(count);
+    slot_world_matrices_.resize(count);
+    slot_dirty_.assign(count, 0);
+    slot_previous_world_matrices_.resize(count);
+    slot_previous_steps_.assign(count, 0); // slots have moved
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t slot = order_slots[i];
+        slot_entities_[slot] = order[i];
+        slot_parents_[slot] = (order_parents[i] == NO_PARENT) ? NO_PARENT : order_slots[order_parents[i]];
+
+        const uint32_t index = entityIndex(order[i]);
+        if (index >= entity_slots_.size()) entity_slots_.resize(index + 1, NO_SLOT);
+        entity_slots_[index] = slot;
+        const TransformComponent* t = m_scene->ReadComponent<TransformComponent>(order[i]);
+        slot_local_matrices_[slot] = LocalMatrix(*t);
+        slot_world_matrices_[slot] = t->world_matrix;
+    }
+
+    tombstone_count_ = 0;
+    pending_entities_.clear();
+    slots_reparent_version_ = m_scene->GetReparentVersion();
+}
+
+glm::mat4 TransformSystem::GetInterpolatedWorldMatrix(Entity entity, float alpha) const
+{
+    const glm::mat4x3& world_matrix = m_scene->ReadComponent<TransformComponent>(entity)->world_matrix;
+    const glm::mat4x3* previous = GetPreviousWorldMatrix(entity);
+    return glm::mat4(previous ? InterpolateMatrix(*previous, world_matrix, alpha) : world_matrix);
 }
 
 } // namespace engine
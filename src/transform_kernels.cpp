@@ -0,0 +1,313 @@
+#include "transform_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define ENGINE_TRANSFORM_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ENGINE_TARGET_AVX2
+#define ENGINE_FORCE_INLINE static __forceinline
+#else
+#define ENGINE_TARGET_AVX2 __attribute__((target("avx2")))
+#define ENGINE_FORCE_INLINE static inline __attribute__((always_inline))
+#endif
+#endif
+
+namespace engine {
+
+static void ComposeScalar(const TransformArrays& trs, size_t begin, size_t end, glm::mat4x3* out)
+{
+    for (size_t i = begin; i < end; ++i) {
+        const float x = trs.rotation[0][i], y = trs.rotation[1][i], z = trs.rotation[2][i], w = trs.rotation[3][i];
+        const float sx = trs.scale[0][i], sy = trs.scale[1][i], sz = trs.scale[2][i];
+        glm::mat4x3& m = out[i - begin];
+        m[0] = glm::vec3((1.0f - 2.0f * (y * y + z * z)) * sx, 2.0f * (x * y + w * z) * sx, 2.0f * (x * z - w * y) * sx);
+        m[1] = glm::vec3(2.0f * (x * y - w * z) * sy, (1.0f - 2.0f * (x * x + z * z)) * sy, 2.0f * (y * z + w * x) * sy);
+        m[2] = glm::vec3(2.0f * (x * z + w * y) * sz, 2.0f * (y * z - w * x) * sz, (1.0f - 2.0f * (x * x + y * y)) * sz);
+        m[3] = glm::vec3(trs.position[0][i], trs.position[1][i], trs.position[2][i]);
+    }
+}
+
+static void MultiplyScalar(glm::mat4x3* world, const glm::mat4x3* local, const uint32_t* parents, const uint32_t* slots, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t slot = slots[i];
+        const glm::mat4x3& p = world[parents[slot]];
+        const glm::mat4x3& l = local[slot];
+        glm::mat4x3 result;
+        for (int c = 0; c < 3; ++c) {
+            result[c] = p[0] * l[c][0] + p[1] * l[c][1] + p[2] * l[c][2];
+        }
+        result[3] = p[0] * l[3][0] + p[1] * l[3][1] + p[2] * l[3][2] + p[3];
+        world[slot] = result;
+    }
+}
+
+#ifdef ENGINE_TRANSFORM_KERNELS_X86
+
+/*
+ * Loads the 4 columns of an affine matrix into separate registers, the last lane of each being left undefined.
+ * Only the matrix's 12 floats are read.
+ */
+ENGINE_FORCE_INLINE void LoadAffine(const glm::mat4x3& m, __m128 columns[4])
+{
+    const float* f = &m[0][0];
+    const __m128 f0 = _mm_loadu_ps(f);     // c0x c0y c0z c1x
+    const __m128 f1 = _mm_loadu_ps(f + 4); // c1y c1z c2x c2y
+    const __m128 f2 = _mm_loadu_ps(f + 8); // c2z c3x c3y c3z
+    const __m128 c1 = _mm_shuffle_ps(f0, f1, _MM_SHUFFLE(1, 0, 3, 3));
+    columns[0] = f0;
+    columns[1] = _mm_shuffle_ps(c1, c1, _MM_SHUFFLE(3, 3, 2, 0));
+    columns[2] = _mm_shuffle_ps(f1, f2, _MM_SHUFFLE(0, 0, 3, 2));
+    columns[3] = _mm_shuffle_ps(f2, f2, _MM_SHUFFLE(3, 3, 2, 1));
+}
+
+// Packs the first 3 lanes of each column into the matrix's 12 floats
+ENGINE_FORCE_INLINE void StoreAffine(glm::mat4x3& m, const __m128 columns[4])
+{
+    float* f = &m[0][0];
+    const __m128 t0 = _mm_shuffle_ps(columns[0], columns[1], _MM_SHUFFLE(0, 0, 2, 2));
+    const __m128 t2 = _mm_shuffle_ps(columns[2], columns[3], _MM_SHUFFLE(0, 0, 2, 2));
+    _mm_storeu_ps(f, _mm_shuffle_ps(columns[0], t0, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(f + 4, _mm_shuffle_ps(columns[1], columns[2], _MM_SHUFFLE(1, 0, 2, 1)));
+    _mm_storeu_ps(f + 8, _mm_shuffle_ps(t2, columns[3], _MM_SHUFFLE(2, 1, 2, 0)));
+}
+
+// Transposes the elements of 4 local matrices, one lane per transform and m[column][row], into 4 consecutive matrices
+ENGINE_FORCE_INLINE void StoreComposed4(const __m128 m[4][3], glm::mat4x3* out)
+{
+    __m128 columns[4][4]; // [transform][column]
+    for (int c = 0; c < 4; ++c) {
+        __m128 r0 = m[c][0], r1 = m[c][1], r2 = m[c][2], r3 = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        columns[0][c] = r0;
+        columns[1][c] = r1;
+        columns[2][c] = r2;
+        columns[3][c] = r3;
+    }
+    for (int k = 0; k < 4; ++k) {
+        StoreAffine(out[k], columns[k]);
+    }
+}
+
+ENGINE_FORCE_INLINE void MultiplyAffineOne(glm::mat4x3* world, const glm::mat4x3* local, uint32_t parent, uint32_t slot)
+{
+    __m128 p[4];
+    LoadAffine(world[parent], p);
+    const glm::mat4x3& l = local[slot];
+    __m128 result[4];
+    for (int c = 0; c < 4; ++c) {
+        result[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p[0], _mm_set1_ps(l[c][0])), _mm_mul_ps(p[1], _mm_set1_ps(l[c][1]))), _mm_mul_ps(p[2], _mm_set1_ps(l[c][2])));
+    }
+    result[3] = _mm_add_ps(result[3], p[3]);
+    StoreAffine(world[slot], result);
+}
+
+static void ComposeSSE2(const TransformArrays& trs, size_t begin, size_t end, glm::mat4x3* out)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 x = _mm_loadu_ps(&trs.rotation[0][i]);
+        const __m128 y = _mm_loadu_ps(&trs.rotation[1][i]);
+        const __m128 z = _mm_loadu_ps(&trs.rotation[2][i]);
+        const __m128 w = _mm_loadu_ps(&trs.rotation[3][i]);
+        const __m128 sx = _mm_loadu_ps(&trs.scale[0][i]);
+        const __m128 sy = _mm_loadu_ps(&trs.scale[1][i]);
+        const __m128 sz = _mm_loadu_ps(&trs.scale[2][i]);
+
+        const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        __m128 m[4][3];
+        m[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        m[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        m[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+        m[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        m[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        m[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+        m[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        m[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        m[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+        m[3][0] = _mm_loadu_ps(&trs.position[0][i]);
+        m[3][1] = _mm_loadu_ps(&trs.position[1][i]);
+        m[3][2] = _mm_loadu_ps(&trs.position[2][i]);
+        StoreComposed4(m, out + (i - begin));
+    }
+    ComposeScalar(trs, i, end, out + (i - begin));
+}
+
+static void MultiplySSE2(glm::mat4x3* world, const glm::mat4x3* local, const uint32_t* parents, const uint32_t* slots, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        MultiplyAffineOne(world, local, parents[slots[i]], slots[i]);
+    }
+}
+
+// The helpers above are force-inlined, so they're compiled with VEX encoding here and don't switch instruction sets mid-kernel.
+ENGINE_TARGET_AVX2 static void ComposeAVX2(const TransformArrays& trs, size_t begin, size_t end, glm::mat4x3* out)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 x = _mm256_loadu_ps(&trs.rotation[0][i]);
+        const __m256 y = _mm256_loadu_ps(&trs.rotation[1][i]);
+        const __m256 z = _mm256_loadu_ps(&trs.rotation[2][i]);
+        const __m256 w = _mm256_loadu_ps(&trs.rotation[3][i]);
+        const __m256 sx = _mm256_loadu_ps(&trs.scale[0][i]);
+        const __m256 sy = _mm256_loadu_ps(&trs.scale[1][i]);
+        const __m256 sz = _mm256_loadu_ps(&trs.scale[2][i]);
+
+        const __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+        const __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+        const __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+        __m256 m[4][3];
+        m[0][0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx);
+        m[0][1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+        m[0][2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+        m[1][0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+        m[1][1] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy);
+        m[1][2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+        m[2][0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+        m[2][1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+        m[2][2] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz);
+        m[3][0] = _mm256_loadu_ps(&trs.position[0][i]);
+        m[3][1] = _mm256_loadu_ps(&trs.position[1][i]);
+        m[3][2] = _mm256_loadu_ps(&trs.position[2][i]);
+
+        // each half of the registers holds 4 transforms
+        __m128 low[4][3], high[4][3];
+        for (int c = 0; c < 4; ++c) {
+            for (int r = 0; r < 3; ++r) {
+                low[c][r] = _mm256_castps256_ps128(m[c][r]);
+                high[c][r] = _mm256_extractf128_ps(m[c][r], 1);
+            }
+        }
+        StoreComposed4(low, out + (i - begin));
+        StoreComposed4(high, out + (i - begin) + 4);
+    }
+    // avoids the penalty of switching to SSE code with the upper halves of the registers in use
+    _mm256_zeroupper();
+    ComposeScalar(trs, i, end, out + (i - begin));
+}
+
+ENGINE_TARGET_AVX2 static void MultiplyAVX2(glm::mat4x3* world, const glm::mat4x3* local, const uint32_t* parents, const uint32_t* slots, size_t count)
+{
+    size_t i = 0;
+    while (i + 2 <= count) {
+        const uint32_t a = slots[i], b = slots[i + 1];
+        // b's parent has to be final before it is read
+        if (parents[b] == a) {
+            MultiplyAffineOne(world, local, parents[a], a);
+            ++i;
+            continue;
+        }
+        // one matrix in each half of the registers
+        __m128 pa[4], pb[4], la[4], lb[4];
+        LoadAffine(world[parents[a]], pa);
+        LoadAffine(world[parents[b]], pb);
+        LoadAffine(local[a], la);
+        LoadAffine(local[b], lb);
+        __m256 p[4], result[4];
+        for (int c = 0; c < 4; ++c) {
+            p[c] = _mm256_insertf128_ps(_mm256_castps128_ps256(pa[c]), pb[c], 1);
+        }
+        for (int c = 0; c < 4; ++c) {
+            const __m256 l = _mm256_insertf128_ps(_mm256_castps128_ps256(la[c]), lb[c], 1);
+            result[c] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p[0], _mm256_permute_ps(l, 0x00)), _mm256_mul_ps(p[1], _mm256_permute_ps(l, 0x55))),
+                                      _mm256_mul_ps(p[2], _mm256_permute_ps(l, 0xAA)));
+        }
+        result[3] = _mm256_add_ps(result[3], p[3]);
+        __m128 ra[4], rb[4];
+        for (int c = 0; c < 4; ++c) {
+            ra[c] = _mm256_castps256_ps128(result[c]);
+            rb[c] = _mm256_extractf128_ps(result[c], 1);
+        }
+        StoreAffine(world[a], ra);
+        StoreAffine(world[b], rb);
+        i += 2;
+    }
+    if (i < count) MultiplyAffineOne(world, local, parents[slots[i]], slots[i]);
+    _mm256_zeroupper();
+}
+
+static bool CpuSupportsAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    // the OS has to save the YMM registers across context switches
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+TransformKernelLevel GetTransformKernelLevel()
+{
+#ifdef ENGINE_TRANSFORM_KERNELS_X86
+    static const TransformKernelLevel s_level = CpuSupportsAVX2() ? TransformKernelLevel::AVX2 : TransformKernelLevel::SSE2;
+    return s_level;
+#else
+    return TransformKernelLevel::SCALAR;
+#endif
+}
+
+const char* GetTransformKernelName(TransformKernelLevel level)
+{
+    switch (level) {
+        case TransformKernelLevel::SSE2:
+            return "SSE2";
+        case TransformKernelLevel::AVX2:
+            return "AVX2";
+        default:
+            return "scalar";
+    }
+}
+
+void ComposeTransforms(const TransformArrays& trs, size_t begin, size_t end, glm::mat4x3* out)
+{
+    ComposeTransforms(trs, begin, end, out, GetTransformKernelLevel());
+}
+
+void ComposeTransforms(const TransformArrays& trs, size_t begin, size_t end, glm::mat4x3* out, TransformKernelLevel level)
+{
+#ifdef ENGINE_TRANSFORM_KERNELS_X86
+    if (level == TransformKernelLevel::AVX2) return ComposeAVX2(trs, begin, end, out);
+    if (level == TransformKernelLevel::SSE2) return ComposeSSE2(trs, begin, end, out);
+#else
+    (void)level;
+#endif
+    ComposeScalar(trs, begin, end, out);
+}
+
+void MultiplyAffineTransforms(glm::mat4x3* world, const glm::mat4x3* local, const uint32_t* parents, const uint32_t* slots, size_t count)
+{
+    MultiplyAffineTransforms(world, local, parents, slots, count, GetTransformKernelLevel());
+}
+
+void MultiplyAffineTransforms(glm::mat4x3* world, const glm::mat4x3* local, const uint32_t* parents, const uint32_t* slots, size_t count,
+                              TransformKernelLevel level)
+{
+#ifdef ENGINE_TRANSFORM_KERNELS_X86
+    if (level == TransformKernelLevel::AVX2) return MultiplyAVX2(world, local, parents, slots, count);
+    if (level == TransformKernelLevel::SSE2) return MultiplySSE2(world, local, parents, slots, count);
+#else
+    (void)level;
+#endif
+    MultiplyScalar(world, local, parents, slots, count);
+}
+
+} // namespace engine
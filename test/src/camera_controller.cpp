@@ -19,21 +19,22 @@
 #include "window.h"
 
 CameraControllerSystem::CameraControllerSystem(engine::Scene* scene)
-    : System(scene, {typeid(engine::TransformComponent).hash_code(), typeid(CameraControllerComponent).hash_code()})
+    : System(scene, {engine::getComponentTypeId<engine::TransformComponent>(), engine::getComponentTypeId<CameraControllerComponent>()})
 {
 }
 
 void CameraControllerSystem::onUpdate(float ts)
 {
-    if (t == nullptr || c == nullptr) {
-        for (engine::Entity entity : m_entities) {
-            t = m_scene->GetComponent<engine::TransformComponent>(entity);
-            c = m_scene->GetComponent<CameraControllerComponent>(entity);
-            break;
-        }
-        if (t == nullptr) return;
-        if (c == nullptr) return;
+    // component pointers are refetched every frame as component storage may move when entities change
+    t = nullptr;
+    c = nullptr;
+    for (engine::Entity entity : m_entities) {
+        t = m_scene->GetComponent<engine::TransformComponent>(entity);
+        c = m_scene->GetComponent<CameraControllerComponent>(entity);
+        break;
     }
+    if (t == nullptr) return;
+    if (c == nullptr) return;
 
     const float dt = ts;
 
@@ -228,7 +229,7 @@ void CameraControllerSystem::onUpdate(float ts)
             LOG_TRACE("Location: {} {} {}", cast.location.x, cast.location.y, cast.location.z);
             LOG_TRACE("Normal: {} {} {}", cast.normal.x, cast.normal.y, cast.normal.z);
             LOG_TRACE("Ray direction: {} {} {}", ray.direction.x, ray.direction.y, ray.direction.z);
-            LOG_TRACE("Hit Entity: {}", m_scene->GetComponent<engine::TransformComponent>(cast.hit_entity)->tag);
+            LOG_TRACE("Hit Entity: {}", m_scene->GetEntityTag(cast.hit_entity));
             c->perm_lines.clear();
             c->perm_lines.emplace_back(ray.origin, cast.location, glm::vec3{0.0f, 0.0f, 1.0f});
             m_scene->GetComponent<engine::MeshRenderableComponent>(cast.hit_entity)->visible ^= true;
@@ -80,7 +80,7 @@ void PlayGame(GameSettings settings)
         sphere_ren->visible = true;
         // start_scene->GetPosition(sphere).z += 0f;
 
-        start_scene->RegisterComponent<CameraControllerComponent>();
+        start_scene->RegisterComponent<CameraControllerComponent>(engine::ComponentStorage::SPARSE_SET);
         start_scene->RegisterSystemAtIndex<CameraControllerSystem>(0);
         start_scene->AddComponent<CameraControllerComponent>(camera)->noclip = false;
         start_scene->GetPosition(camera).z += 10.0f;
@@ -105,7 +105,7 @@ void PlayGame(GameSettings settings)
         camera_transform->position = {0.0f, 0.0f, 100.0f};
         camera_transform->is_static = false;
 
-        main_scene->RegisterComponent<CameraControllerComponent>();
+        main_scene->RegisterComponent<CameraControllerComponent>(engine::ComponentStorage::SPARSE_SET);
         main_scene->RegisterSystemAtIndex<CameraControllerSystem>(0);
         main_scene->AddComponent<CameraControllerComponent>(camera);
 
@@ -207,26 +207,26 @@ void PlayGame(GameSettings settings)
         constexpr unsigned int LANDS_SEED = 69420;
         const engine::Entity lands_parent = main_scene->CreateEntity("lands_parent");
         main_scene->GetTransform(lands_parent)->is_static = true;
-        engine::Entity lands[LANDS_SIZE][LANDS_SIZE]{};
-        for (int y = 0; y < LANDS_SIZE; ++y) {
-            for (int x = 0; x < LANDS_SIZE; ++x) {
-                lands[x][y] = main_scene->CreateEntity("land[" + std::to_string(x) + "][" + std::to_string(y) + "]", lands_parent);
-
-                const auto land_ren = main_scene->AddComponent<engine::MeshRenderableComponent>(lands[x][y]);
-                land_ren->mesh = genTerrainChunk(app.getRenderer()->GetDevice(), (float)x, (float)y, LANDS_UV_SCALE, LANDS_SEED);
-                land_ren->material = land_material;
-                land_ren->visible = true;
-
-                const auto land_col = main_scene->AddComponent<engine::ColliderComponent>(lands[x][y]);
-                land_col->aabb.min = glm::vec3{-std::numeric_limits<float>::epsilon(), -std::numeric_limits<float>::epsilon(), 0.0f};
-                land_col->aabb.max = glm::vec3{1.0f + std::numeric_limits<float>::epsilon(), 1.0f + std::numeric_limits<float>::epsilon(), 0.01f};
-
-                main_scene->GetPosition(lands[x][y]) = glm::vec3{(float)x * LANDS_XY_SCALE - (LANDS_XY_SCALE * 0.5f * (float)LANDS_SIZE),
-                                                                 (float)y * LANDS_XY_SCALE - (LANDS_XY_SCALE * 0.5f * (float)LANDS_SIZE), 0.0f};
-                main_scene->GetScale(lands[x][y]) = glm::vec3{LANDS_XY_SCALE, LANDS_XY_SCALE, LANDS_HEIGHT};
-                main_scene->GetTransform(lands[x][y])->is_static = true;
-            }
-        }
+        main_scene->CreateEntities<engine::MeshRenderableComponent, engine::ColliderComponent>(
+            LANDS_SIZE * LANDS_SIZE, lands_parent,
+            [&](size_t i, engine::Entity, engine::TransformComponent& land_t, engine::MeshRenderableComponent& land_ren, engine::ColliderComponent& land_col) {
+                const int x = static_cast<int>(i) % LANDS_SIZE;
+                const int y = static_cast<int>(i) / LANDS_SIZE;
+
+                land_t.tag_id = main_scene->InternTag("land[" + std::to_string(x) + "][" + std::to_string(y) + "]");
+
+                land_ren.mesh = genTerrainChunk(app.getRenderer()->GetDevice(), (float)x, (float)y, LANDS_UV_SCALE, LANDS_SEED);
+                land_ren.material = land_material;
+                land_ren.visible = true;
+
+                land_col.aabb.min = glm::vec3{-std::numeric_limits<float>::epsilon(), -std::numeric_limits<float>::epsilon(), 0.0f};
+                land_col.aabb.max = glm::vec3{1.0f + std::numeric_limits<float>::epsilon(), 1.0f + std::numeric_limits<float>::epsilon(), 0.01f};
+
+                land_t.position = glm::vec3{(float)x * LANDS_XY_SCALE - (LANDS_XY_SCALE * 0.5f * (float)LANDS_SIZE),
+                                            (float)y * LANDS_XY_SCALE - (LANDS_XY_SCALE * 0.5f * (float)LANDS_SIZE), 0.0f};
+                land_t.scale = glm::vec3{LANDS_XY_SCALE, LANDS_XY_SCALE, LANDS_HEIGHT};
+                land_t.is_static = true;
+            });
     }
 
     start_scene->GetSystem<CameraControllerSystem>()->next_scene_ = main_scene;